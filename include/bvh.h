@@ -1,25 +1,96 @@
 #pragma once
 #include <algorithm>
+#include <type_traits>
+#include <cstdint>
+#include <omp.h>
 #include "shape.h"
+#include "triangle_soa.h"
 
 struct BVHNode {
     BVHNode* left = NULL;
     BVHNode* right = NULL;
     int n, index;
     vec3 AA, BB;
+    int height = 0; // 子树高度，只在树旋转时维护
 };
 
-bool cmpx(const Triangle& t1, const Triangle& t2) {
-    return t1.center.x < t2.center.x;
+// BVH 构建方式
+enum BVHBuildType {
+    BVH_MEDIAN,     // 最长轴排序后中点划分
+    BVH_SAH,        // 分桶 SAH（表面积启发式）
+    BVH_LBVH,       // Morton 码排序后线性构建，构建最快，树的质量较差
+    BVH_LBVH_OPT,   // LBVH 之后再做一遍树旋转优化
+    BVH_SBVH        // 带空间划分的 SAH，适合细长三角形很多的模型，三角形引用会有重复
+};
+
+// SAH 代价模型参数。叶子里的三角形按 4/8 个一组做 SIMD 求交，单个三角形比访问一个节点便宜得多；
+// 两者取 1:1 时几乎每个叶子只剩一个三角形，取 4:1 时叶子平均能放 3~6 个三角形
+const int SAH_BINS = 16;
+const float SAH_TRAVERSAL_COST = 1.0f;   // 访问一个内部节点的代价
+const float SAH_INTERSECT_COST = 0.25f;  // 一次三角形求交的代价
+
+// SBVH 参数：对象划分两侧包围盒重叠面积占根节点面积的比例超过 SBVH_ALPHA 时才尝试空间划分；
+// 重复的三角形引用最多为原三角形数的 SBVH_MAX_DUPLICATION 倍
+const int SBVH_BINS = 16;
+const float SBVH_ALPHA = 1e-5f;
+const float SBVH_MAX_DUPLICATION = 0.3f;
+
+// 构建时图元数超过这个阈值的子树交给 OpenMP task 并行构建，更小的子树直接串行递归
+const int BVH_PARALLEL_THRESHOLD = 4096;
+
+#ifdef BVH_STATS
+// 遍历统计，用于比较不同构建方式的质量（多线程下只是近似值）
+long long bvhNodeVisits = 0;
+long long bvhTriangleTests = 0;
+#endif
+
+// 扁平化的 BVH 节点：整棵树按深度优先顺序存放在一个连续数组里，
+// 左孩子紧跟在父节点之后，只需记录右孩子的位置，不含任何指针
+struct LinearBVHNode {
+    vec3 AA;
+    int offset;     // 叶子：第一个三角形的下标；内部节点：右孩子在数组中的下标
+    vec3 BB;
+    int n;          // 叶子中的三角形个数，内部节点为 0
+};
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode should be 32 bytes");
+static_assert(std::is_trivially_copyable<LinearBVHNode>::value, "LinearBVHNode should be trivially copyable");
+
+// 遍历时显式栈的大小；各种构建方式在深度达到 BVH_STACK_SIZE - 2 时都直接生成叶子，扁平化时再检查一次
+const int BVH_STACK_SIZE = 64;
+
+// 构建用的轻量图元：只保存包围盒、中心和原始下标
+struct BVHPrimitive {
+    vec3 AA, BB;
+    vec3 center;
+    int index;
+};
+
+// 构建时对网格三角形的只读访问：共享的顶点数组加上每 3 个一组的顶点下标
+struct IndexedTriangles {
+    const std::vector<vec3>& vertices;
+    const std::vector<uint32_t>& indices;
+
+    int size() const { return (int) indices.size() / 3; }
+    vec3 vertex(int tri, int k) const { return vertices[indices[tri * 3 + k]]; }
+};
+
+float surfaceArea(vec3 AA, vec3 BB) {
+    vec3 d = BB - AA;
+    if (d.x < 0 || d.y < 0 || d.z < 0) return 0;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+bool cmpx(const BVHPrimitive& p1, const BVHPrimitive& p2) {
+    return p1.center.x < p2.center.x;
 }
-bool cmpy(const Triangle& t1, const Triangle& t2) {
-    return t1.center.y < t2.center.y;
+bool cmpy(const BVHPrimitive& p1, const BVHPrimitive& p2) {
+    return p1.center.y < p2.center.y;
 }
-bool cmpz(const Triangle& t1, const Triangle& t2) {
-    return t1.center.z < t2.center.z;
+bool cmpz(const BVHPrimitive& p1, const BVHPrimitive& p2) {
+    return p1.center.z < p2.center.z;
 }
 
-BVHNode* buildBVH(std::vector<Triangle>& triangles, int l, int r, int n) {
+BVHNode* buildBVH(std::vector<BVHPrimitive>& prims, int l, int r, int n, int depth = 0) {
     if (l > r) return 0;
 
     BVHNode* node = new BVHNode();
@@ -27,24 +98,12 @@ BVHNode* buildBVH(std::vector<Triangle>& triangles, int l, int r, int n) {
     node->BB = vec3(-INF, -INF, -INF);
 
     for (int i = l; i <= r; i++) {
-
-        float minx = std::min(triangles[i].p1.x, std::min(triangles[i].p2.x, triangles[i].p3.x));
-        float miny = std::min(triangles[i].p1.y, std::min(triangles[i].p2.y, triangles[i].p3.y));
-        float minz = std::min(triangles[i].p1.z, std::min(triangles[i].p2.z, triangles[i].p3.z));
-        node->AA.x = std::min(node->AA.x, minx);
-        node->AA.y = std::min(node->AA.y, miny);
-        node->AA.z = std::min(node->AA.z, minz);
-
-        float maxx = std::max(triangles[i].p1.x, std::max(triangles[i].p2.x, triangles[i].p3.x));
-        float maxy = std::max(triangles[i].p1.y, std::max(triangles[i].p2.y, triangles[i].p3.y));
-        float maxz = std::max(triangles[i].p1.z, std::max(triangles[i].p2.z, triangles[i].p3.z));
-        node->BB.x = std::max(node->BB.x, maxx);
-        node->BB.y = std::max(node->BB.y, maxy);
-        node->BB.z = std::max(node->BB.z, maxz);
+        node->AA = min(node->AA, prims[i].AA);
+        node->BB = max(node->BB, prims[i].BB);
     }
 
 
-    if ((r - l + 1) <= n) {
+    if ((r - l + 1) <= n || depth >= BVH_STACK_SIZE - 2) {
         node->n = r - l + 1;
         node->index = l;
         return node;
@@ -55,64 +114,931 @@ BVHNode* buildBVH(std::vector<Triangle>& triangles, int l, int r, int n) {
     float leny = node->BB.y - node->AA.y;
     float lenz = node->BB.z - node->AA.z;
 
-    if (lenx >= leny && lenx >= lenz)
-        std::sort(triangles.begin() + l, triangles.begin() + r + 1, cmpx);
+    // 只需要按最长轴把中位数放到 mid，两侧内部的顺序由下一层决定，用 nth_element 代替整段排序
+    bool (*cmp)(const BVHPrimitive&, const BVHPrimitive&) = cmpx;
+    if (leny >= lenx && leny >= lenz) cmp = cmpy;
+    if (lenz >= lenx && lenz >= leny) cmp = cmpz;
 
-    if (leny >= lenx && leny >= lenz)
-        std::sort(triangles.begin() + l, triangles.begin() + r + 1, cmpy);
+    int mid = (l + r) / 2;
+    std::nth_element(prims.begin() + l, prims.begin() + mid, prims.begin() + r + 1, cmp);
 
-    if (lenz >= lenx && lenz >= leny)
-        std::sort(triangles.begin() + l, triangles.begin() + r + 1, cmpz);
+    if (r - l + 1 > BVH_PARALLEL_THRESHOLD) {
+#pragma omp task shared(prims)
+        node->left = buildBVH(prims, l, mid, n, depth + 1);
+        node->right = buildBVH(prims, mid + 1, r, n, depth + 1);
+#pragma omp taskwait
+    } else {
+        node->left = buildBVH(prims, l, mid, n, depth + 1);
+        node->right = buildBVH(prims, mid + 1, r, n, depth + 1);
+    }
 
-    int mid = (l + r) / 2;
-    node->left = buildBVH(triangles, l, mid, n);
-    node->right = buildBVH(triangles, mid + 1, r, n);
+    return node;
+}
+
+// 一次划分的结果：axis 为 -1 表示没有可用的划分
+struct BVHSplit {
+    float cost = INF;
+    int axis = -1;
+    int bin = -1;           // 对象划分：左边包含的最后一个桶
+    float position = 0;     // 空间划分：划分平面的位置
+    vec3 leftAA, leftBB, rightAA, rightBB;
+};
+
+// 图元中心在 [CA, CB] 上第 axis 轴所在的桶
+inline int objectBin(const BVHPrimitive& p, int axis, vec3 CA, vec3 CB) {
+    float scale = SAH_BINS / (CB[axis] - CA[axis]);
+    return std::min(SAH_BINS - 1, int((p.center[axis] - CA[axis]) * scale));
+}
+
+// 分桶 SAH：对每个轴把 [l, r] 中图元的中心分到 SAH_BINS 个桶里，扫描所有桶边界，返回估计遍历代价最小的划分
+BVHSplit findObjectSplit(const std::vector<BVHPrimitive>& prims, int l, int r, vec3 CA, vec3 CB, float area) {
+    struct Bin {
+        vec3 AA = vec3(INF, INF, INF);
+        vec3 BB = vec3(-INF, -INF, -INF);
+        int count = 0;
+    };
+
+    BVHSplit best;
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = CB[axis] - CA[axis];
+        if (extent <= 0) continue;
+
+        Bin bins[SAH_BINS];
+        for (int i = l; i <= r; i++) {
+            int b = objectBin(prims[i], axis, CA, CB);
+            bins[b].count++;
+            bins[b].AA = min(bins[b].AA, prims[i].AA);
+            bins[b].BB = max(bins[b].BB, prims[i].BB);
+        }
+
+        // 从右往左累积，rightAA[i] / rightBB[i] 表示桶 i..SAH_BINS-1 的包围盒
+        vec3 rightAA[SAH_BINS], rightBB[SAH_BINS];
+        int rightCount[SAH_BINS];
+        vec3 AA = vec3(INF, INF, INF), BB = vec3(-INF, -INF, -INF);
+        int cnt = 0;
+        for (int i = SAH_BINS - 1; i > 0; i--) {
+            AA = min(AA, bins[i].AA);
+            BB = max(BB, bins[i].BB);
+            cnt += bins[i].count;
+            rightAA[i] = AA;
+            rightBB[i] = BB;
+            rightCount[i] = cnt;
+        }
+
+        AA = vec3(INF, INF, INF), BB = vec3(-INF, -INF, -INF);
+        cnt = 0;
+        for (int i = 0; i < SAH_BINS - 1; i++) {
+            AA = min(AA, bins[i].AA);
+            BB = max(BB, bins[i].BB);
+            cnt += bins[i].count;
+            if (cnt == 0 || rightCount[i + 1] == 0) continue;
+            float cost = SAH_TRAVERSAL_COST + SAH_INTERSECT_COST *
+                         (surfaceArea(AA, BB) * cnt + surfaceArea(rightAA[i + 1], rightBB[i + 1]) * rightCount[i + 1]) / area;
+            if (cost < best.cost) {
+                best.cost = cost;
+                best.axis = axis;
+                best.bin = i;
+                best.leftAA = AA, best.leftBB = BB;
+                best.rightAA = rightAA[i + 1], best.rightBB = rightBB[i + 1];
+            }
+        }
+    }
+    return best;
+}
+
+// 分桶 SAH 构建：选估计遍历代价最小的轴和位置划分；当不划分更便宜且图元数不超过 n 时直接生成叶子
+BVHNode* buildBVHSAH(std::vector<BVHPrimitive>& prims, int l, int r, int n, int depth = 0) {
+    if (l > r) return 0;
+
+    BVHNode* node = new BVHNode();
+    node->AA = vec3(INF, INF, INF);
+    node->BB = vec3(-INF, -INF, -INF);
+    vec3 CA = vec3(INF, INF, INF);
+    vec3 CB = vec3(-INF, -INF, -INF);
+    for (int i = l; i <= r; i++) {
+        node->AA = min(node->AA, prims[i].AA);
+        node->BB = max(node->BB, prims[i].BB);
+        CA = min(CA, prims[i].center);
+        CB = max(CB, prims[i].center);
+    }
+
+    int count = r - l + 1;
+    if (count == 1) {
+        node->n = 1;
+        node->index = l;
+        return node;
+    }
+
+    BVHSplit split = findObjectSplit(prims, l, r, CA, CB, surfaceArea(node->AA, node->BB));
+
+    // 太深时直接生成叶子，保证扁平化时不会超过遍历栈的大小
+    float leafCost = SAH_INTERSECT_COST * count;
+    if (depth >= BVH_STACK_SIZE - 2 || (count <= n && (split.axis == -1 || leafCost <= split.cost))) {
+        node->n = count;
+        node->index = l;
+        return node;
+    }
+
+    int mid;
+    if (split.axis == -1) {
+        // 所有中心重合，无法按位置划分，只能对半分
+        mid = (l + r) / 2;
+    } else {
+        auto it = std::partition(prims.begin() + l, prims.begin() + r + 1, [&](const BVHPrimitive& p) {
+            return objectBin(p, split.axis, CA, CB) <= split.bin;
+        });
+        mid = int(it - prims.begin()) - 1;
+    }
+
+    if (count > BVH_PARALLEL_THRESHOLD) {
+#pragma omp task shared(prims)
+        node->left = buildBVHSAH(prims, l, mid, n, depth + 1);
+        node->right = buildBVHSAH(prims, mid + 1, r, n, depth + 1);
+#pragma omp taskwait
+    } else {
+        node->left = buildBVHSAH(prims, l, mid, n, depth + 1);
+        node->right = buildBVHSAH(prims, mid + 1, r, n, depth + 1);
+    }
+
+    return node;
+}
+
+std::vector<BVHPrimitive> makePrimitives(const IndexedTriangles& tris) {
+    std::vector<BVHPrimitive> prims(tris.size());
+#pragma omp parallel for
+    for (int i = 0; i < tris.size(); i++) {
+        vec3 p1 = tris.vertex(i, 0), p2 = tris.vertex(i, 1), p3 = tris.vertex(i, 2);
+        prims[i].AA = min(p1, min(p2, p3));
+        prims[i].BB = max(p1, max(p2, p3));
+        prims[i].center = (p1 + p2 + p3) / 3.0f;
+        prims[i].index = i;
+    }
+    return prims;
+}
+
+// 按构建后图元的顺序重排下标数组，使叶子的下标区间对应连续的三角形；
+// SBVH 中同一个三角形可能被多个叶子引用，这时它的 3 个下标会出现多次
+void reorderIndices(std::vector<uint32_t>& indices, const std::vector<BVHPrimitive>& prims) {
+    std::vector<uint32_t> ordered(prims.size() * 3);
+#pragma omp parallel for
+    for (int i = 0; i < (int) prims.size(); i++) {
+        for (int k = 0; k < 3; k++) {
+            ordered[i * 3 + k] = indices[prims[i].index * 3 + k];
+        }
+    }
+    indices.swap(ordered);
+}
+
+BVHNode* buildBVHSAH(const std::vector<vec3>& vertices, std::vector<uint32_t>& indices, int n) {
+    std::vector<BVHPrimitive> prims = makePrimitives({vertices, indices});
+
+    BVHNode* root = NULL;
+#pragma omp parallel
+#pragma omp single
+    root = buildBVHSAH(prims, 0, (int) prims.size() - 1, n);
+
+    reorderIndices(indices, prims);
+    return root;
+}
+
+// 在 10 位整数的相邻两位之间各插入两个 0
+inline uint64_t expandBits10(uint64_t v) {
+    v &= 0x3ff;
+    v = (v | v << 16) & 0x30000ff;
+    v = (v | v << 8) & 0x300f00f;
+    v = (v | v << 4) & 0x30c30c3;
+    v = (v | v << 2) & 0x9249249;
+    return v;
+}
+
+// 在 21 位整数的相邻两位之间各插入两个 0
+inline uint64_t expandBits21(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v << 8) & 0x100f00f00f00f00full;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+// p 的各分量已归一化到 [0, 1]，bits 为每个轴的位数（10 得到 30 位码，21 得到 63 位码）
+inline uint64_t mortonCode(vec3 p, int bits) {
+    float scale = float((1 << bits) - 1);
+    uint64_t x = uint64_t(std::min(std::max(p.x * scale, 0.0f), scale));
+    uint64_t y = uint64_t(std::min(std::max(p.y * scale, 0.0f), scale));
+    uint64_t z = uint64_t(std::min(std::max(p.z * scale, 0.0f), scale));
+    if (bits == 10)
+        return expandBits10(x) << 2 | expandBits10(y) << 1 | expandBits10(z);
+    return expandBits21(x) << 2 | expandBits21(y) << 1 | expandBits21(z);
+}
+
+// 按 Morton 码对图元下标做稳定的 LSD 基数排序，每趟 8 位：每个线程统计自己那一段的直方图，
+// 按 (桶, 线程) 的顺序求前缀和后各自写回，所有码在这一段上都相同的趟直接跳过
+void radixSortMorton(std::vector<uint64_t>& codes, std::vector<int>& order, int keyBits) {
+    const int RADIX_BITS = 8;
+    const int BUCKETS = 1 << RADIX_BITS;
+    int count = (int) codes.size();
+    int maxThreads = omp_get_max_threads();
+    std::vector<uint64_t> codes2(count);
+    std::vector<int> order2(count);
+    std::vector<int> hist(maxThreads * BUCKETS);
+
+    for (int shift = 0; shift < keyBits; shift += RADIX_BITS) {
+        bool skip = false;
+#pragma omp parallel num_threads(maxThreads)
+        {
+            int tid = omp_get_thread_num();
+            int nt = omp_get_num_threads();
+            int begin = int((long long) count * tid / nt);
+            int end = int((long long) count * (tid + 1) / nt);
+            int* h = &hist[tid * BUCKETS];
+            std::fill(h, h + BUCKETS, 0);
+            for (int i = begin; i < end; i++) {
+                h[(codes[i] >> shift) & (BUCKETS - 1)]++;
+            }
+#pragma omp barrier
+#pragma omp single
+            {
+                int sum = 0;
+                for (int b = 0; b < BUCKETS; b++) {
+                    int total = 0;
+                    for (int t = 0; t < nt; t++) {
+                        int c = hist[t * BUCKETS + b];
+                        hist[t * BUCKETS + b] = sum;
+                        sum += c;
+                        total += c;
+                    }
+                    if (total == count) skip = true;
+                }
+            }
+            if (!skip) {
+                for (int i = begin; i < end; i++) {
+                    int dst = h[(codes[i] >> shift) & (BUCKETS - 1)]++;
+                    codes2[dst] = codes[i];
+                    order2[dst] = order[i];
+                }
+            }
+        }
+        if (!skip) {
+            codes.swap(codes2);
+            order.swap(order2);
+        }
+    }
+}
+
+// 对已按 Morton 码排好序的区间 [l, r] 自顶向下建树：在 codes[l] 和 codes[r] 最高的不同位处划分，
+// 划分位置用二分查找得到；码完全相同时只能对半分
+BVHNode* buildLBVH(const std::vector<BVHPrimitive>& prims, const std::vector<uint64_t>& codes, int l, int r, int n,
+                   int depth = 0) {
+    BVHNode* node = new BVHNode();
+    int count = r - l + 1;
+    if (count <= n || depth >= BVH_STACK_SIZE - 2) {
+        node->AA = vec3(INF, INF, INF);
+        node->BB = vec3(-INF, -INF, -INF);
+        for (int i = l; i <= r; i++) {
+            node->AA = min(node->AA, prims[i].AA);
+            node->BB = max(node->BB, prims[i].BB);
+        }
+        node->n = count;
+        node->index = l;
+        return node;
+    }
+
+    int mid;
+    uint64_t first = codes[l], last = codes[r];
+    if (first == last) {
+        mid = (l + r) / 2;
+    } else {
+        // 与 first 的公共前缀比 first、last 的公共前缀更长的最后一个位置
+        int prefix = __builtin_clzll(first ^ last);
+        mid = l;
+        int step = r - l;
+        do {
+            step = (step + 1) / 2;
+            int next = mid + step;
+            if (next < r && __builtin_clzll(first ^ codes[next]) > prefix) mid = next;
+        } while (step > 1);
+    }
+
+    if (count > BVH_PARALLEL_THRESHOLD) {
+#pragma omp task shared(prims, codes)
+        node->left = buildLBVH(prims, codes, l, mid, n, depth + 1);
+        node->right = buildLBVH(prims, codes, mid + 1, r, n, depth + 1);
+#pragma omp taskwait
+    } else {
+        node->left = buildLBVH(prims, codes, l, mid, n, depth + 1);
+        node->right = buildLBVH(prims, codes, mid + 1, r, n, depth + 1);
+    }
+    node->AA = min(node->left->AA, node->right->AA);
+    node->BB = max(node->left->BB, node->right->BB);
+    return node;
+}
+
+// 树旋转（Kensler 2008），即大小为 3 的 treelet 重排：自底向上检查每个节点，
+// 尝试把一个孩子和另一个孩子的某个子节点交换，能减小被修改孩子的包围盒面积就执行。
+// 父节点的包围盒不变，所以 SAH 代价只会下降。被交换下去的孩子深了一层，
+// 如果这会让叶子超过构建时的深度上限就不交换，顺带维护每个节点的 height
+void rotateBVH(BVHNode* node, int depth = 0) {
+    if (node->n > 0) return;
+    if (depth < 6) { // 上面几层拆成 task，下面的子树串行处理
+#pragma omp task
+        rotateBVH(node->left, depth + 1);
+        rotateBVH(node->right, depth + 1);
+#pragma omp taskwait
+    } else {
+        rotateBVH(node->left, depth + 1);
+        rotateBVH(node->right, depth + 1);
+    }
 
+    for (int side = 0; side < 2; side++) {
+        BVHNode*& a = side ? node->right : node->left;  // 待交换的孩子
+        BVHNode* b = side ? node->left : node->right;   // 另一个孩子，交换它的子节点
+        if (b->n > 0) continue;
+
+        float best = surfaceArea(b->AA, b->BB);
+        int choice = -1;
+        float withRight = surfaceArea(min(a->AA, b->right->AA), max(a->BB, b->right->BB));
+        float withLeft = surfaceArea(min(a->AA, b->left->AA), max(a->BB, b->left->BB));
+        if (withRight < best) best = withRight, choice = 0;   // a 与 b->left 交换
+        if (withLeft < best) best = withLeft, choice = 1;     // a 与 b->right 交换
+        if (choice == -1 || depth + 2 + a->height > BVH_STACK_SIZE - 2) continue;
+
+        BVHNode*& grandchild = choice == 0 ? b->left : b->right;
+        std::swap(a, grandchild);
+        b->AA = min(b->left->AA, b->right->AA);
+        b->BB = max(b->left->BB, b->right->BB);
+        b->height = 1 + std::max(b->left->height, b->right->height);
+    }
+    node->height = 1 + std::max(node->left->height, node->right->height);
+}
+
+// LBVH：用三角形中心的 Morton 码排序，再按码的二进制前缀划分；三角形很多时 10 位一个轴区分不开，改用 63 位码
+BVHNode* buildLBVH(const std::vector<vec3>& vertices, std::vector<uint32_t>& indices, int n, bool optimize) {
+    std::vector<BVHPrimitive> prims = makePrimitives({vertices, indices});
+    int count = (int) prims.size();
+
+    vec3 CA = vec3(INF, INF, INF), CB = vec3(-INF, -INF, -INF);
+    for (auto& p: prims) {
+        CA = min(CA, p.center);
+        CB = max(CB, p.center);
+    }
+    vec3 extent = max(CB - CA, vec3(1e-12f));
+
+    int bits = count > (1 << 20) ? 21 : 10;
+    std::vector<uint64_t> codes(count);
+    std::vector<int> order(count);
+#pragma omp parallel for
+    for (int i = 0; i < count; i++) {
+        codes[i] = mortonCode((prims[i].center - CA) / extent, bits);
+        order[i] = i;
+    }
+    radixSortMorton(codes, order, bits * 3);
+
+    std::vector<BVHPrimitive> sorted(count);
+#pragma omp parallel for
+    for (int i = 0; i < count; i++) {
+        sorted[i] = prims[order[i]];
+    }
+    prims.swap(sorted);
+
+    BVHNode* root = NULL;
+#pragma omp parallel
+#pragma omp single
+    {
+        root = buildLBVH(prims, codes, 0, count - 1, n);
+        if (optimize) rotateBVH(root);
+    }
+
+    reorderIndices(indices, prims);
+    return root;
+}
+
+// 用平面 axis = position 把引用 ref 对应的三角形在 ref 包围盒内的部分切成两半，分别求出两侧的包围盒
+void splitReference(const IndexedTriangles& tris, BVHPrimitive ref, int axis, float position,
+                    BVHPrimitive& left, BVHPrimitive& right) {
+    left.AA = right.AA = vec3(INF, INF, INF);
+    left.BB = right.BB = vec3(-INF, -INF, -INF);
+    vec3 v[3] = {tris.vertex(ref.index, 0), tris.vertex(ref.index, 1), tris.vertex(ref.index, 2)};
+    for (int i = 0; i < 3; i++) {
+        vec3 p = v[i], q = v[(i + 1) % 3];
+        if (p[axis] <= position) left.AA = min(left.AA, p), left.BB = max(left.BB, p);
+        if (p[axis] >= position) right.AA = min(right.AA, p), right.BB = max(right.BB, p);
+        // 边穿过平面时，交点同时属于两侧
+        if ((p[axis] < position && q[axis] > position) || (p[axis] > position && q[axis] < position)) {
+            vec3 x = mix(p, q, (position - p[axis]) / (q[axis] - p[axis]));
+            x[axis] = position;
+            left.AA = min(left.AA, x), left.BB = max(left.BB, x);
+            right.AA = min(right.AA, x), right.BB = max(right.BB, x);
+        }
+    }
+    left.AA = max(left.AA, ref.AA), left.BB = min(left.BB, ref.BB);
+    right.AA = max(right.AA, ref.AA), right.BB = min(right.BB, ref.BB);
+    left.center = 0.5f * (left.AA + left.BB);
+    right.center = 0.5f * (right.AA + right.BB);
+    left.index = right.index = ref.index;
+}
+
+// 空间划分：把节点包围盒按 axis 等分成 SBVH_BINS 个桶，跨越多个桶的引用被切开后分别计入，
+// 左侧数量按引用进入的桶、右侧按离开的桶统计
+BVHSplit findSpatialSplit(const std::vector<BVHPrimitive>& refs, const IndexedTriangles& tris,
+                          vec3 nodeAA, vec3 nodeBB, float area) {
+    struct Bin {
+        vec3 AA = vec3(INF, INF, INF);
+        vec3 BB = vec3(-INF, -INF, -INF);
+        int enter = 0, exit = 0;
+    };
+
+    BVHSplit best;
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = nodeBB[axis] - nodeAA[axis];
+        if (extent <= 0) continue;
+        float width = extent / SBVH_BINS;
+
+        Bin bins[SBVH_BINS];
+        for (auto& ref: refs) {
+            int first = std::min(SBVH_BINS - 1, std::max(0, int((ref.AA[axis] - nodeAA[axis]) / width)));
+            int last = std::min(SBVH_BINS - 1, std::max(first, int((ref.BB[axis] - nodeAA[axis]) / width)));
+            BVHPrimitive rest = ref, part;
+            for (int b = first; b < last; b++) {
+                splitReference(tris, rest, axis, nodeAA[axis] + width * (b + 1), part, rest);
+                bins[b].AA = min(bins[b].AA, part.AA);
+                bins[b].BB = max(bins[b].BB, part.BB);
+            }
+            bins[last].AA = min(bins[last].AA, rest.AA);
+            bins[last].BB = max(bins[last].BB, rest.BB);
+            bins[first].enter++;
+            bins[last].exit++;
+        }
+
+        vec3 rightAA[SBVH_BINS], rightBB[SBVH_BINS];
+        int rightCount[SBVH_BINS];
+        vec3 AA = vec3(INF, INF, INF), BB = vec3(-INF, -INF, -INF);
+        int cnt = 0;
+        for (int i = SBVH_BINS - 1; i > 0; i--) {
+            AA = min(AA, bins[i].AA);
+            BB = max(BB, bins[i].BB);
+            cnt += bins[i].exit;
+            rightAA[i] = AA;
+            rightBB[i] = BB;
+            rightCount[i] = cnt;
+        }
+
+        AA = vec3(INF, INF, INF), BB = vec3(-INF, -INF, -INF);
+        cnt = 0;
+        for (int i = 0; i < SBVH_BINS - 1; i++) {
+            AA = min(AA, bins[i].AA);
+            BB = max(BB, bins[i].BB);
+            cnt += bins[i].enter;
+            if (cnt == 0 || rightCount[i + 1] == 0) continue;
+            float cost = SAH_TRAVERSAL_COST + SAH_INTERSECT_COST *
+                         (surfaceArea(AA, BB) * cnt + surfaceArea(rightAA[i + 1], rightBB[i + 1]) * rightCount[i + 1]) / area;
+            if (cost < best.cost) {
+                best.cost = cost;
+                best.axis = axis;
+                best.position = nodeAA[axis] + width * (i + 1);
+                best.leftAA = AA, best.leftBB = BB;
+                best.rightAA = rightAA[i + 1], best.rightBB = rightBB[i + 1];
+            }
+        }
+    }
+    return best;
+}
+
+// 按空间划分把引用分到两侧。跨越平面的引用先比较“切开”“整个放左边”“整个放右边”三种做法的代价，
+// 只有切开更便宜时才复制（reference unsplitting）
+void performSpatialSplit(std::vector<BVHPrimitive>& refs, const IndexedTriangles& tris, const BVHSplit& split,
+                         std::vector<BVHPrimitive>& left, std::vector<BVHPrimitive>& right) {
+    int axis = split.axis;
+    vec3 LA = split.leftAA, LB = split.leftBB, RA = split.rightAA, RB = split.rightBB;
+    int nl = 0, nr = 0;
+    for (auto& ref: refs) {
+        if (ref.AA[axis] < split.position) nl++;
+        if (ref.BB[axis] > split.position) nr++;
+    }
+
+    for (auto& ref: refs) {
+        if (ref.BB[axis] <= split.position) {
+            left.push_back(ref);
+        } else if (ref.AA[axis] >= split.position) {
+            right.push_back(ref);
+        } else {
+            float areaL = surfaceArea(LA, LB), areaR = surfaceArea(RA, RB);
+            float splitCost = areaL * nl + areaR * nr;
+            float toLeft = surfaceArea(min(LA, ref.AA), max(LB, ref.BB)) * nl + areaR * (nr - 1);
+            float toRight = areaL * (nl - 1) + surfaceArea(min(RA, ref.AA), max(RB, ref.BB)) * nr;
+            if (toLeft < splitCost && toLeft <= toRight) {
+                left.push_back(ref);
+                LA = min(LA, ref.AA), LB = max(LB, ref.BB);
+                nr--;
+            } else if (toRight < splitCost) {
+                right.push_back(ref);
+                RA = min(RA, ref.AA), RB = max(RB, ref.BB);
+                nl--;
+            } else {
+                BVHPrimitive l, r;
+                splitReference(tris, ref, axis, split.position, l, r);
+                left.push_back(l);
+                right.push_back(r);
+            }
+        }
+    }
+}
+
+// SBVH（Stich 2009）：每个节点同时考虑对象划分和空间划分，叶子的引用依次追加到 out。
+// budget 是还允许新增的重复引用数，用完后退化为普通 SAH
+BVHNode* buildSBVH(std::vector<BVHPrimitive>& refs, const IndexedTriangles& tris, std::vector<BVHPrimitive>& out,
+                   int n, float rootArea, int& budget, int depth = 0) {
+    BVHNode* node = new BVHNode();
+    node->AA = vec3(INF, INF, INF);
+    node->BB = vec3(-INF, -INF, -INF);
+    vec3 CA = vec3(INF, INF, INF);
+    vec3 CB = vec3(-INF, -INF, -INF);
+    for (auto& ref: refs) {
+        node->AA = min(node->AA, ref.AA);
+        node->BB = max(node->BB, ref.BB);
+        CA = min(CA, ref.center);
+        CB = max(CB, ref.center);
+    }
+
+    int count = (int) refs.size();
+    float area = surfaceArea(node->AA, node->BB);
+    BVHSplit split;
+    if (count > 1) split = findObjectSplit(refs, 0, count - 1, CA, CB, area);
+
+    // 对象划分两侧重叠明显时，再看空间划分是否更好
+    bool spatial = false;
+    if (count > n && budget > 0 && split.axis != -1) {
+        vec3 overlapAA = max(split.leftAA, split.rightAA);
+        vec3 overlapBB = min(split.leftBB, split.rightBB);
+        if (surfaceArea(overlapAA, overlapBB) > SBVH_ALPHA * rootArea) {
+            BVHSplit s = findSpatialSplit(refs, tris, node->AA, node->BB, area);
+            if (s.axis != -1 && s.cost < split.cost) {
+                split = s;
+                spatial = true;
+            }
+        }
+    }
+
+    // 太深时直接生成叶子，保证扁平化时不会超过遍历栈的大小
+    float leafCost = SAH_INTERSECT_COST * count;
+    if (count == 1 || depth >= BVH_STACK_SIZE - 2 || (count <= n && (split.axis == -1 || leafCost <= split.cost))) {
+        node->n = count;
+        node->index = (int) out.size();
+        out.insert(out.end(), refs.begin(), refs.end());
+        return node;
+    }
+
+    std::vector<BVHPrimitive> left, right;
+    if (spatial) {
+        performSpatialSplit(refs, tris, split, left, right);
+        int added = (int) (left.size() + right.size()) - count;
+        if (left.empty() || right.empty() || added > budget) {
+            left.clear(), right.clear();
+            spatial = false;
+            split = findObjectSplit(refs, 0, count - 1, CA, CB, area);
+        } else {
+            budget -= added;
+        }
+    }
+    if (!spatial) {
+        if (split.axis == -1) {
+            // 所有中心重合，只能对半分
+            left.assign(refs.begin(), refs.begin() + count / 2);
+            right.assign(refs.begin() + count / 2, refs.end());
+        } else {
+            for (auto& ref: refs) {
+                if (objectBin(ref, split.axis, CA, CB) <= split.bin) left.push_back(ref);
+                else right.push_back(ref);
+            }
+        }
+    }
+    std::vector<BVHPrimitive>().swap(refs); // 子节点构建时不再需要，尽早释放
+
+    node->left = buildSBVH(left, tris, out, n, rootArea, budget, depth + 1);
+    node->right = buildSBVH(right, tris, out, n, rootArea, budget, depth + 1);
     return node;
 }
 
-// 和 aabb 盒子求交，没有交点则返回 -1
-float hitAABB(Ray r, vec3 AA, vec3 BB) {
-    // 1.0 / direction
-    vec3 invdir = vec3(1.0 / r.direction.x, 1.0 / r.direction.y, 1.0 / r.direction.z);
+// 空间划分需要在全局的重复预算下按顺序决定，所以 SBVH 是串行构建的
+BVHNode* buildSBVH(const std::vector<vec3>& vertices, std::vector<uint32_t>& indices, int n) {
+    IndexedTriangles tris = {vertices, indices};
+    std::vector<BVHPrimitive> refs = makePrimitives(tris);
+    std::vector<BVHPrimitive> out;
+    out.reserve(refs.size());
+    vec3 AA = vec3(INF, INF, INF), BB = vec3(-INF, -INF, -INF);
+    for (auto& ref: refs) {
+        AA = min(AA, ref.AA);
+        BB = max(BB, ref.BB);
+    }
+    int budget = int(refs.size() * SBVH_MAX_DUPLICATION);
+    BVHNode* root = buildSBVH(refs, tris, out, n, surfaceArea(AA, BB), budget);
+    reorderIndices(indices, out);
+    return root;
+}
 
-    vec3 in = (BB - r.startPoint) * invdir;
-    vec3 out = (AA - r.startPoint) * invdir;
+// 在并行区域里由一个线程开始递归，大的子树再以 task 的形式分给其他线程
+BVHNode* buildBVH(const std::vector<vec3>& vertices, std::vector<uint32_t>& indices, BVHBuildType type, int n) {
+    if (type == BVH_SAH)
+        return buildBVHSAH(vertices, indices, n);
+    if (type == BVH_LBVH || type == BVH_LBVH_OPT)
+        return buildLBVH(vertices, indices, n, type == BVH_LBVH_OPT);
+    if (type == BVH_SBVH)
+        return buildSBVH(vertices, indices, n);
+    std::vector<BVHPrimitive> prims = makePrimitives({vertices, indices});
+    BVHNode* root = NULL;
+#pragma omp parallel
+#pragma omp single
+    root = buildBVH(prims, 0, (int) prims.size() - 1, n);
+    reorderIndices(indices, prims);
+    return root;
+}
+
+// 把指针树按深度优先顺序写入 nodes，返回该子树根节点的下标；
+// 树深超过遍历栈的大小时返回 -1，由调用者换成平衡的中点划分重新构建
+int flattenBVH(BVHNode* root, std::vector<LinearBVHNode>& nodes, int depth = 0) {
+    if (depth >= BVH_STACK_SIZE) return -1;
+    int index = (int) nodes.size();
+    nodes.push_back(LinearBVHNode());
+    LinearBVHNode& node = nodes[index];
+    node.AA = root->AA;
+    node.BB = root->BB;
+    node.n = root->n;
+    node.offset = root->index;
+    if (root->n == 0) {
+        if (flattenBVH(root->left, nodes, depth + 1) < 0) return -1;
+        int right = flattenBVH(root->right, nodes, depth + 1);
+        if (right < 0) return -1;
+        nodes[index].offset = right; // push_back 之后 node 引用可能已失效
+    }
+    return index;
+}
+
+void deleteBVH(BVHNode* root) {
+    if (root == NULL) return;
+    deleteBVH(root->left);
+    deleteBVH(root->right);
+    delete root;
+}
+
+// 构建并压缩成线性数组，中间的指针树随即释放；indices 按叶子顺序重排，叶子的 offset / n 以三角形为单位
+std::vector<LinearBVHNode> buildLinearBVH(const std::vector<vec3>& vertices, std::vector<uint32_t>& indices, BVHBuildType type, int n) {
+    std::vector<LinearBVHNode> nodes;
+    if (indices.empty()) return nodes;
+    BVHNode* root = buildBVH(vertices, indices, type, n);
+    if (flattenBVH(root, nodes) < 0) {
+        // 构建时都限制了深度，正常不会走到这里
+        printf("BVH is deeper than %d levels, rebuilding with median splits\n", BVH_STACK_SIZE);
+        deleteBVH(root);
+        nodes.clear();
+        root = buildBVH(vertices, indices, BVH_MEDIAN, n);
+        flattenBVH(root, nodes);
+    }
+    deleteBVH(root);
+    return nodes;
+}
+
+// 使用预先算好的 1 / direction，并以 tMax 裁剪：返回进入盒子的距离（起点在盒内时为 0），
+// 没有交点或进入距离超过 tMax 时返回 -1
+float hitAABB(const vec3& origin, const vec3& invdir, const vec3& AA, const vec3& BB, float tMax) {
+    vec3 in = (BB - origin) * invdir;
+    vec3 out = (AA - origin) * invdir;
 
     vec3 tmax = max(in, out);
     vec3 tmin = min(in, out);
 
     float t1 = std::min(tmax.x, std::min(tmax.y, tmax.z));
     float t0 = std::max(tmin.x, std::max(tmin.y, tmin.z));
+    t0 = std::max(t0, 0.0f);
 
-    return (t1 >= t0) ? ((t0 > 0.0) ? (t0) : (t1)) : (-1);
+    return (t1 >= t0 && t0 <= tMax) ? t0 : -1;
 }
 
-HitResult hitTriangleArray(Ray ray, std::vector<Triangle>& triangles, int l, int r) {
-    HitResult res;
-    for (int i = l; i <= r; i++) {
-        HitResult rst = triangles[i].intersect(ray);
-        if (rst.isHit && rst.distance < res.distance) {
-            res = rst;
+// 多叉 BVH 的宽度，与 SoA 三角形的 SIMD 宽度一致：AVX2 下为 8 叉，其余为 4 叉
+const int BVH_WIDTH = SOA_WIDTH > 1 ? SOA_WIDTH : 4;
+
+// 由二叉 BVH 合并得到的多叉节点，孩子的包围盒按分量分开存放，一次 SIMD 就能测试所有孩子。
+// 叶子直接内联在父节点里：count[i] > 0 时 child[i] 是第一个图元的下标，否则是孩子节点的下标；
+// 空位的包围盒为 [INF, -INF]，求交必然失败
+struct WideBVHNode {
+    float minX[BVH_WIDTH], minY[BVH_WIDTH], minZ[BVH_WIDTH];
+    float maxX[BVH_WIDTH], maxY[BVH_WIDTH], maxZ[BVH_WIDTH];
+    int child[BVH_WIDTH];
+    int count[BVH_WIDTH];
+};
+static_assert(std::is_trivially_copyable<WideBVHNode>::value, "WideBVHNode should be trivially copyable");
+
+// 把二叉节点 index 的子树合并成一个多叉节点：反复展开表面积最大的内部孩子，直到填满 BVH_WIDTH 个，返回其下标。
+// 每个多叉节点至少吃掉一层二叉节点，所以多叉树不会比二叉树深，遍历栈 BVH_STACK_SIZE * BVH_WIDTH 足够
+int collapseBVH(const std::vector<LinearBVHNode>& nodes, int index, std::vector<WideBVHNode>& wide) {
+    int slots[BVH_WIDTH];
+    int num = 0;
+    if (nodes[index].n > 0) {
+        slots[num++] = index; // 整棵树只有一个叶子
+    } else {
+        slots[num++] = index + 1;
+        slots[num++] = nodes[index].offset;
+    }
+    while (num < BVH_WIDTH) {
+        int best = -1;
+        float bestArea = -1;
+        for (int i = 0; i < num; i++) {
+            const LinearBVHNode& c = nodes[slots[i]];
+            if (c.n > 0) continue;
+            float area = surfaceArea(c.AA, c.BB);
+            if (area > bestArea) {
+                bestArea = area;
+                best = i;
+            }
+        }
+        if (best == -1) break;
+        int expand = slots[best];
+        slots[best] = expand + 1;
+        slots[num++] = nodes[expand].offset;
+    }
+
+    int w = (int) wide.size();
+    wide.push_back(WideBVHNode());
+    for (int i = 0; i < BVH_WIDTH; i++) {
+        WideBVHNode& node = wide[w];
+        if (i >= num) {
+            node.minX[i] = node.minY[i] = node.minZ[i] = INF;
+            node.maxX[i] = node.maxY[i] = node.maxZ[i] = -INF;
+            node.child[i] = -1;
+            node.count[i] = 0;
+            continue;
+        }
+        const LinearBVHNode& c = nodes[slots[i]];
+        node.minX[i] = c.AA.x, node.minY[i] = c.AA.y, node.minZ[i] = c.AA.z;
+        node.maxX[i] = c.BB.x, node.maxY[i] = c.BB.y, node.maxZ[i] = c.BB.z;
+        node.count[i] = c.n;
+        node.child[i] = c.offset;
+        if (c.n == 0) {
+            int child = collapseBVH(nodes, slots[i], wide);
+            wide[w].child[i] = child; // 递归之后 node 引用可能已失效
         }
     }
-    return res;
+    return w;
 }
 
-HitResult hitBVH(Ray ray, std::vector<Triangle>& triangles, BVHNode* root) {
-    if (root == NULL) return HitResult();
+std::vector<WideBVHNode> buildWideBVH(const std::vector<LinearBVHNode>& nodes) {
+    std::vector<WideBVHNode> wide;
+    if (!nodes.empty()) collapseBVH(nodes, 0, wide);
+    return wide;
+}
 
-    if (root->n > 0) {
-        return hitTriangleArray(ray, triangles, root->n, root->n + root->index - 1);
+// 多叉节点求交用的光线：预先算好 1 / direction，并按方向的正负决定每个轴先碰到 min 还是 max 平面，
+// 这样不需要逐轴取 min / max，空位的反向包围盒也自然不会命中
+struct WideRay {
+    vec3 origin, invdir;
+    bool negative[3];
+#if SOA_WIDTH > 1
+    vfloat ox, oy, oz;
+    vfloat ix, iy, iz;
+#endif
+
+    explicit WideRay(const Ray& ray) {
+        origin = ray.startPoint;
+        invdir = vec3(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+        for (int i = 0; i < 3; i++) negative[i] = invdir[i] < 0;
+#if SOA_WIDTH > 1
+        ox = vset1(origin.x), oy = vset1(origin.y), oz = vset1(origin.z);
+        ix = vset1(invdir.x), iy = vset1(invdir.y), iz = vset1(invdir.z);
+#endif
+    }
+};
+
+// 同时测试节点的全部孩子，返回命中孩子的位掩码，dist 写出进入距离（起点在盒内时为 0）
+inline int hitWideNode(const WideBVHNode& node, const WideRay& r, float tMax, float* dist) {
+    const float* nearX = r.negative[0] ? node.maxX : node.minX;
+    const float* farX = r.negative[0] ? node.minX : node.maxX;
+    const float* nearY = r.negative[1] ? node.maxY : node.minY;
+    const float* farY = r.negative[1] ? node.minY : node.maxY;
+    const float* nearZ = r.negative[2] ? node.maxZ : node.minZ;
+    const float* farZ = r.negative[2] ? node.minZ : node.maxZ;
+#if SOA_WIDTH > 1
+    vfloat t0 = vmax(vmax(vmul(vsub(vload(nearX), r.ox), r.ix), vmul(vsub(vload(nearY), r.oy), r.iy)),
+                     vmax(vmul(vsub(vload(nearZ), r.oz), r.iz), vset1(0.0f)));
+    vfloat t1 = vmin(vmin(vmul(vsub(vload(farX), r.ox), r.ix), vmul(vsub(vload(farY), r.oy), r.iy)),
+                     vmin(vmul(vsub(vload(farZ), r.oz), r.iz), vset1(tMax)));
+    vstore(dist, t0);
+    return vmask(vle(t0, t1));
+#else
+    int bits = 0;
+    for (int i = 0; i < BVH_WIDTH; i++) {
+        float t0 = std::max(std::max((nearX[i] - r.origin.x) * r.invdir.x, (nearY[i] - r.origin.y) * r.invdir.y),
+                            std::max((nearZ[i] - r.origin.z) * r.invdir.z, 0.0f));
+        float t1 = std::min(std::min((farX[i] - r.origin.x) * r.invdir.x, (farY[i] - r.origin.y) * r.invdir.y),
+                            std::min((farZ[i] - r.origin.z) * r.invdir.z, tMax));
+        dist[i] = t0;
+        if (t0 <= t1) bits |= 1 << i;
+    }
+    return bits;
+#endif
+}
+
+// 多叉 BVH 的最近交点遍历：命中的孩子按进入距离排序，近的先出栈，并用当前最近交点距离 closest 裁剪更远的节点。
+// leaf(offset, n, closest) 负责叶子中图元的求交，找到更近的交点时更新 closest
+template <typename LeafFunc>
+void traverseBVH(const Ray& ray, const std::vector<WideBVHNode>& nodes, float& closest, LeafFunc leaf) {
+    if (nodes.empty()) return;
+
+    WideRay r(ray);
+    struct StackEntry {
+        int index;
+        int count;      // > 0 表示叶子
+        float distance;
+    } stack[BVH_STACK_SIZE * BVH_WIDTH];
+    int sp = 0;
+    stack[sp++] = {0, 0, 0.0f};
+
+    alignas(32) float dist[BVH_WIDTH];
+    while (sp > 0) {
+        StackEntry entry = stack[--sp];
+        if (entry.distance > closest) continue;
+#ifdef BVH_STATS
+        bvhNodeVisits++;
+#endif
+
+        if (entry.count > 0) {
+            leaf(entry.index, entry.count, closest);
+            continue;
+        }
+
+        const WideBVHNode& node = nodes[entry.index];
+        int bits = hitWideNode(node, r, closest, dist);
+
+        // 插入排序，order 按距离从远到近
+        int order[BVH_WIDTH];
+        int k = 0;
+        while (bits) {
+            int i = __builtin_ctz(bits);
+            bits &= bits - 1;
+            int j = k++;
+            while (j > 0 && dist[order[j - 1]] < dist[i]) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = i;
+        }
+        for (int j = 0; j < k; j++) {
+            int i = order[j];
+            stack[sp++] = {node.child[i], node.count[i], dist[i]};
+        }
+    }
+}
+
+template <typename LeafFunc>
+bool traverseBVHAny(const Ray& ray, const std::vector<WideBVHNode>& nodes, float tMax, LeafFunc leaf) {
+    if (nodes.empty()) return false;
+
+    WideRay r(ray);
+    int stack[BVH_STACK_SIZE * BVH_WIDTH];
+    int sp = 0;
+    stack[sp++] = 0;
+
+    alignas(32) float dist[BVH_WIDTH];
+    while (sp > 0) {
+        const WideBVHNode& node = nodes[stack[--sp]];
+#ifdef BVH_STATS
+        bvhNodeVisits++;
+#endif
+        int bits = hitWideNode(node, r, tMax, dist);
+        while (bits) {
+            int i = __builtin_ctz(bits);
+            bits &= bits - 1;
+            if (node.count[i] > 0) {
+                if (leaf(node.child[i], node.count[i])) return true;
+            } else {
+                stack[sp++] = node.child[i];
+            }
+        }
     }
 
-    float d1 = INF, d2 = INF;
-    if (root->left) d1 = hitAABB(ray, root->left->AA, root->left->BB);
-    if (root->right) d2 = hitAABB(ray, root->right->AA, root->right->BB);
+    return false;
+}
 
-    HitResult r1, r2;
-    if (d1 > 0) r1 = hitBVH(ray, triangles, root->left);
-    if (d2 > 0) r2 = hitBVH(ray, triangles, root->right);
+// 遍历多叉 BVH，叶子使用 SoA 三角形块做 SIMD 求交，rec.primID 与 triangles 的下标一致
+bool hitBVH(const Ray& ray, const TriangleSoA& soa, const std::vector<WideBVHNode>& nodes, HitRecord& rec) {
+    bool hit = false;
+    float closest = rec.distance;
+    traverseBVH(ray, nodes, closest, [&](int offset, int n, float& clip) {
+#ifdef BVH_STATS
+        bvhTriangleTests += n;
+#endif
+        if (hitTriangleSoA(ray, soa, offset, n, rec)) {
+            hit = true;
+            clip = rec.distance;
+        }
+    });
+    return hit;
+}
 
-    return r1.distance < r2.distance ? r1 : r2;
+bool occludedBVH(const Ray& ray, const TriangleSoA& soa, const std::vector<WideBVHNode>& nodes, float tMax) {
+    return traverseBVHAny(ray, nodes, tMax, [&](int offset, int n) {
+#ifdef BVH_STATS
+        bvhTriangleTests += n;
+#endif
+        return occludedTriangleSoA(ray, soa, offset, n, tMax);
+    });
 }
@@ -37,7 +37,7 @@ public:
     }
 
     bool castRay(const vec2& uv, Ray& ray) const override {
-        float t = time0 + randf() * (time1 - time0);
+        float t = time0 + sample1D() * (time1 - time0);
         const vec3 pinholePos = position + focalLength * forward;
         const vec3 sensorPos = position + uv[0] * right + uv[1] * up;
         ray = Ray(sensorPos, normalize(pinholePos - sensorPos), t);
@@ -88,7 +88,7 @@ public:
     }
 
     bool castRay(const vec2& uv, Ray& ray) const override {
-        float t = time0 + randf() * (time1 - time0);
+        float t = time0 + sample1D() * (time1 - time0);
 
         const vec3 sensorPos = position + uv[0] * right + uv[1] * up;
         const vec3 lensCenter = position + a * forward;
@@ -31,8 +31,8 @@ public:
         }
     }
 
-    HitResult intersect(Ray r) override {
-        return HitResult();
+    bool intersect(const Ray& /*r*/, HitRecord& /*rec*/) override {
+        return false;
     }
 
     std::vector<vec3> &getControls() {
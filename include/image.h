@@ -33,4 +33,27 @@ void saveppm(double *S, int width, int height, const char *filename) {
     for (int i = 0; i < 3* height * width; i++)
         fprintf(f, "%d ", ToInteger(*S++));
     fclose(f);
+}
+
+// 把整数缓冲原样存成 ASCII 的 PGM 灰度图：不做 gamma 也不归一化，maxval 取缓冲中的最大值，
+// 既能直接读回原始数值，在看图软件里也就是线性的预览。PGM 的 maxval 最大为 65535
+void savepgm(const int *S, int width, int height, const char *filename) {
+    int maxval = 1;
+    for (int i = 0; i < width * height; i++) maxval = std::max(maxval, S[i]);
+    if (maxval > 65535) {
+        printf("Values up to %d do not fit in a PGM file, %s not saved.\n", maxval, filename);
+        return;
+    }
+    FILE *f = fopen(filename, "wb");
+    if (!f) {
+        printf("Cannot open %s for writing, nothing saved.\n", filename);
+        return;
+    }
+    fprintf(f, "P2\n%d %d\n%d\n", width, height, maxval);
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++)
+            fprintf(f, "%d ", S[i * width + j]);
+        fprintf(f, "\n");
+    }
+    fclose(f);
 }
\ No newline at end of file
@@ -0,0 +1,191 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "shape.h"
+
+// 光源的发光功率：发光强度（三个通道的平均）乘以面积
+inline float lightPower(const Triangle* light) {
+    vec3 erate = light->material.erate;
+    return (erate.x + erate.y + erate.z) / 3.0f * 0.5f * length(cross(light->e1, light->e2));
+}
+
+// 光源 BVH 的节点：包围盒、子树内光源的总功率和法向量锥。
+// 光源两面发光，法向量只关心所在的直线，锥的半角不超过 90 度
+struct LightBVHNode {
+    vec3 AA, BB;
+    vec3 center;        // 包围球，由包围盒算出，采样时用
+    float radius;
+    vec3 axis;          // 法向量锥的轴
+    float cosTheta;     // 锥的半角余弦，0 表示覆盖所有方向
+    float sinTheta;
+    float power;        // 发光强度（三个通道的平均）乘以面积
+    int offset;         // 叶子：光源下标；内部节点：右孩子在数组中的下标
+    int n;              // 叶子为 1，内部节点为 0
+};
+
+// 合并两个法向量锥，返回新的轴和半角（弧度）
+inline void mergeCones(vec3 axisA, float thetaA, vec3 axisB, float thetaB, vec3& axis, float& theta) {
+    const float HALF_PI = 0.5f * PI;
+    if (dot(axisA, axisB) < 0) axisB = -axisB; // 两面发光，翻到同一侧再合并
+    if (thetaB > thetaA) {
+        std::swap(axisA, axisB);
+        std::swap(thetaA, thetaB);
+    }
+    float between = acos(std::min(1.0f, dot(axisA, axisB)));
+    if (between + thetaB <= thetaA) {
+        axis = axisA, theta = thetaA;
+        return;
+    }
+    theta = 0.5f * (thetaA + between + thetaB);
+    vec3 k = cross(axisA, axisB);
+    if (theta >= HALF_PI || length(k) < 1e-6f) {
+        axis = axisA, theta = HALF_PI;
+        return;
+    }
+    // 把 axisA 绕 k 向 axisB 转过 theta - thetaA（Rodrigues 公式，k 与 axisA 垂直）
+    k = normalize(k);
+    float rotate = theta - thetaA;
+    axis = normalize(axisA * cos(rotate) + cross(k, axisA) * sin(rotate));
+}
+
+// 节点对着色点 p 的重要性：功率 / 距离平方，再乘以法向量锥朝向 p 的最大余弦的上界，
+// 即 cos(max(0, θw - θo - θb))，θw 是 p 的方向与锥轴的夹角，θo 是锥的半角，θb 是包围球的张角；
+// 每次采样要算 2log(N) 次，角度的差全部用余弦、正弦的差角公式展开，不调用三角函数。
+// p 落在包围球内时方向和距离都给不出有用的界，只按半径估计
+inline float lightImportance(const LightBVHNode& node, vec3 p) {
+    vec3 d = p - node.center;
+    float d2 = dot(d, d);
+    float r2 = node.radius * node.radius;
+    if (d2 <= r2) return node.power / std::max(r2, 1e-8f);
+
+    float invD = 1.0f / sqrt(d2);
+    float cosW = std::min(1.0f, float(fabs(dot(d, node.axis))) * invD);
+    // θx = θw - θo，小于 0 时余弦上界为 1
+    if (cosW >= node.cosTheta) return node.power / d2;
+    float sinW = sqrt(std::max(0.0f, 1.0f - cosW * cosW));
+    float cosX = cosW * node.cosTheta + sinW * node.sinTheta;
+    float sinX = sinW * node.cosTheta - cosW * node.sinTheta;
+    // θx - θb
+    float sinB = node.radius * invD, cosB = sqrt(1.0f - sinB * sinB);
+    if (cosX >= cosB) return node.power / d2;
+    float cosTheta = cosX * cosB + sinX * sinB;
+    return node.power * std::max(0.0f, cosTheta) / d2;
+}
+
+// 光源选择用的 BVH：每个叶子一个光源，采样时从根开始按两个孩子对着色点的重要性随机走到一个叶子，
+// 每一步只看两个孩子，选一个光源的代价是 O(log N)，同时得到它被选中的概率
+class LightBVH {
+public:
+    std::vector<Triangle*> lights;
+    std::vector<LightBVHNode> nodes;
+    std::vector<int> parent;    // 每个节点的父节点，根为 -1
+    std::vector<int> leaf;      // 每个光源所在的叶子
+
+    LightBVH() {}
+
+    explicit LightBVH(const std::vector<Triangle*>& list) : lights(list) {
+        if (lights.empty()) return;
+        std::vector<int> order(lights.size());
+        for (int i = 0; i < (int) order.size(); i++) order[i] = i;
+        nodes.reserve(2 * lights.size() - 1);
+        leaf.resize(lights.size());
+        build(order, 0, (int) order.size() - 1);
+    }
+
+    int size() const { return (int) lights.size(); }
+
+    // 按重要性从根走到一个叶子，pmf 为选中该光源的概率；u 为 [0, 1) 的随机数，每一层重新缩放后继续使用
+    int sample(vec3 p, double u, float& pmf) const {
+        pmf = 1.0f;
+        int index = 0;
+        while (nodes[index].n == 0) {
+            int left = index + 1, right = nodes[index].offset;
+            float wl = lightImportance(nodes[left], p);
+            float wr = lightImportance(nodes[right], p);
+            float pl = wl + wr > 0 ? wl / (wl + wr) : 0.5f;
+            if (u < pl) {
+                u = u / pl;
+                pmf *= pl;
+                index = left;
+            } else {
+                u = (u - pl) / (1.0 - pl);
+                pmf *= 1.0f - pl;
+                index = right;
+            }
+            u = std::min(u, 1.0 - 1e-12);
+        }
+        return nodes[index].offset;
+    }
+
+    // 在 p 处调用 sample 选中第 light 个光源的概率：从叶子往上走到根，每一层的选择概率和 sample 中的算法相同
+    float pmf(vec3 p, int light) const {
+        float pmf = 1.0f;
+        for (int index = leaf[light]; parent[index] >= 0; index = parent[index]) {
+            int left = parent[index] + 1, right = nodes[parent[index]].offset;
+            float wl = lightImportance(nodes[left], p);
+            float wr = lightImportance(nodes[right], p);
+            float pl = wl + wr > 0 ? wl / (wl + wr) : 0.5f;
+            pmf *= index == left ? pl : 1.0f - pl;
+        }
+        return pmf;
+    }
+
+private:
+    // 按光源中心在最长轴上的中位数划分，递归构建并按深度优先顺序写入 nodes，返回节点下标
+    int build(std::vector<int>& order, int l, int r) {
+        int index = (int) nodes.size();
+        nodes.push_back(LightBVHNode());
+        parent.push_back(-1);
+
+        if (l == r) {
+            Triangle* light = lights[order[l]];
+            LightBVHNode node;
+            node.AA = min(light->p1, min(light->p2, light->p3));
+            node.BB = max(light->p1, max(light->p2, light->p3));
+            node.axis = light->material.normal;
+            node.cosTheta = 1.0f;
+            node.sinTheta = 0.0f;
+            node.power = lightPower(light);
+            node.center = 0.5f * (node.AA + node.BB);
+            node.radius = 0.5f * length(node.BB - node.AA);
+            node.offset = order[l];
+            node.n = 1;
+            leaf[order[l]] = index;
+            nodes[index] = node;
+            return index;
+        }
+
+        vec3 CA = vec3(INF, INF, INF), CB = vec3(-INF, -INF, -INF);
+        for (int i = l; i <= r; i++) {
+            CA = min(CA, lights[order[i]]->center);
+            CB = max(CB, lights[order[i]]->center);
+        }
+        vec3 extent = CB - CA;
+        int axis = extent.x > extent.y && extent.x > extent.z ? 0 : extent.y > extent.z ? 1 : 2;
+        int mid = (l + r) / 2;
+        std::nth_element(order.begin() + l, order.begin() + mid, order.begin() + r + 1, [&](int a, int b) {
+            return lights[a]->center[axis] < lights[b]->center[axis];
+        });
+
+        int left = build(order, l, mid);
+        int right = build(order, mid + 1, r);
+        parent[left] = parent[right] = index;
+        const LightBVHNode& a = nodes[left];
+        const LightBVHNode& b = nodes[right];
+
+        LightBVHNode node;
+        node.AA = min(a.AA, b.AA);
+        node.BB = max(a.BB, b.BB);
+        node.center = 0.5f * (node.AA + node.BB);
+        node.radius = 0.5f * length(node.BB - node.AA);
+        float theta;
+        mergeCones(a.axis, acos(a.cosTheta), b.axis, acos(b.cosTheta), node.axis, theta);
+        node.cosTheta = std::max(0.0f, cos(theta));
+        node.sinTheta = sin(theta);
+        node.power = a.power + b.power;
+        node.offset = right;
+        node.n = 0;
+        nodes[index] = node;
+        return index;
+    }
+};
@@ -0,0 +1,106 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include "light_bvh.h"
+
+// 光源选择方式
+enum LightSamplingType {
+    LIGHT_POWER,    // 按功率的别名表，O(1)，与着色点位置无关
+    LIGHT_BVH       // 光源 BVH，按功率、朝向和距离选择，O(log N)
+};
+
+// Vose 别名表：按给定的权重在 O(1) 时间内抽取下标
+struct AliasTable {
+    std::vector<float> prob;    // 落在第 i 格时保留 i 的概率，否则取 alias[i]
+    std::vector<int> alias;
+    std::vector<float> pmf;     // 每个下标被抽中的概率
+
+    AliasTable() {}
+
+    explicit AliasTable(const std::vector<float>& weights) {
+        int n = (int) weights.size();
+        if (n == 0) return;
+        prob.assign(n, 1.0f);
+        alias.resize(n);
+        pmf.resize(n);
+        for (int i = 0; i < n; i++) alias[i] = i;
+
+        double sum = 0;
+        for (float w: weights) sum += w;
+        if (sum <= 0) {
+            // 权重全为 0 时退化为均匀选择
+            pmf.assign(n, 1.0f / n);
+            return;
+        }
+
+        // 缩放到平均值为 1，小于 1 的格子用大于 1 的格子补满
+        std::vector<double> scaled(n);
+        std::vector<int> small, large;
+        for (int i = 0; i < n; i++) {
+            pmf[i] = float(weights[i] / sum);
+            scaled[i] = weights[i] / sum * n;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty()) {
+            int s = small.back(), l = large.back();
+            small.pop_back();
+            prob[s] = float(scaled[s]);
+            alias[s] = l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // 剩下的格子只差舍入误差，直接保留自己
+        for (int i: small) prob[i] = 1.0f;
+        for (int i: large) prob[i] = 1.0f;
+    }
+
+    // u 为 [0, 1) 的随机数，整数部分选格子，小数部分决定取格子本身还是它的别名
+    int sample(double u, float& p) const {
+        int n = (int) prob.size();
+        double x = u * n;
+        int i = std::min(int(x), n - 1);
+        int k = x - i < prob[i] ? i : alias[i];
+        p = pmf[k];
+        return k;
+    }
+};
+
+// NEE 时选择光源：场景中的发光三角形加上选择方式对应的结构，只构建用到的那一个
+class LightSampler {
+public:
+    std::vector<Triangle*> lights;
+    LightSamplingType type;
+    LightBVH tree;
+    AliasTable table;
+    std::unordered_map<const Shape*, int> index; // 光源在 lights 中的下标
+
+    LightSampler(const std::vector<Triangle*>& list, LightSamplingType type = LIGHT_BVH) : lights(list), type(type) {
+        if (lights.empty()) return;
+        for (int i = 0; i < (int) lights.size(); i++) index[lights[i]] = i;
+        if (type == LIGHT_BVH) {
+            tree = LightBVH(lights);
+        } else {
+            std::vector<float> power(lights.size());
+            for (int i = 0; i < (int) lights.size(); i++) power[i] = lightPower(lights[i]);
+            table = AliasTable(power);
+        }
+    }
+
+    int size() const { return (int) lights.size(); }
+
+    // 为着色点 p 选一个光源，pmf 为选中它的概率
+    Triangle* sample(vec3 p, double u, float& pmf) const {
+        int i = type == LIGHT_BVH ? tree.sample(p, u, pmf) : table.sample(u, pmf);
+        return lights[i];
+    }
+
+    // 在 p 处调用 sample 选中 light 的概率，light 不是光源时为 0
+    float pmf(vec3 p, const Shape* light) const {
+        auto it = index.find(light);
+        if (it == index.end()) return 0;
+        return type == LIGHT_BVH ? tree.pmf(p, it->second) : table.pmf[it->second];
+    }
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 只读的内存映射文件，析构时自动解除映射；Windows 下退化为整个读入内存
+class MappedFile {
+public:
+    const char* data = nullptr;
+    size_t size = 0;
+
+    MappedFile() {}
+
+    explicit MappedFile(const char* filename) {
+        open(filename);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const char* filename) {
+        close();
+#ifdef _WIN32
+        std::ifstream f(filename, std::ios::binary | std::ios::ate);
+        if (!f.is_open()) return false;
+        buffer.resize((size_t) f.tellg());
+        f.seekg(0);
+        f.read(buffer.data(), buffer.size());
+        data = buffer.data();
+        size = buffer.size();
+        return true;
+#else
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        size = (size_t) st.st_size;
+        if (size > 0) {
+            void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                size = 0;
+                return false;
+            }
+            data = (const char*) p;
+        } else {
+            data = "";
+        }
+        ::close(fd); // 映射建立后就可以关闭文件描述符
+        return true;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        std::vector<char>().swap(buffer);
+#else
+        if (data && size > 0) munmap((void*) data, size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    bool isOpen() const { return data != nullptr; }
+
+private:
+#ifdef _WIN32
+    std::vector<char> buffer;
+#endif
+};
+
+// MurmurHash3 的 64 位终结函数：可逆，输入的每一位都会影响输出的所有位
+inline uint64_t fmix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// 按 8 字节一组的 64 位哈希，可以接着上一次的结果继续累积。每个字异或进来后都用 fmix64 打散一次，
+// 不会像逐字 FNV-1a 那样只向高位传播（两个字的最高位同时翻转会互相抵消）；只用于缓存校验，不要求抗碰撞
+inline uint64_t hashBytes(const void* bytes, size_t size, uint64_t hash = 14695981039346656037ull) {
+    const unsigned char* p = (const unsigned char*) bytes;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, p + i, 8);
+        hash = fmix64(hash ^ word);
+    }
+    // 不足 8 字节的尾部补零成一个字，再混入长度，补零和真实的零字节不会混淆
+    uint64_t tail = 0;
+    memcpy(&tail, p + i, size - i);
+    hash = fmix64(hash ^ tail);
+    return fmix64(hash ^ size);
+}
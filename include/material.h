@@ -42,7 +42,7 @@ float smithG_GGX_aniso(float NdotV, float VdotX, float VdotY, float ax, float ay
 }
 
 //L 是反弹方向，V 是入射方向的负方向，N 是表面法线
-vec3 BRDF_Evaluate(vec3 V, vec3 N, vec3 L, Material material, vec3 Cdlin) {
+vec3 BRDF_Evaluate(vec3 V, vec3 N, vec3 L, const Material& material, vec3 Cdlin) {
     float NdotL = dot(N, L);
     float NdotV = dot(N, V);
     if(NdotL < 0 || NdotV < 0) return vec3(0);
@@ -92,3 +92,84 @@ vec3 BRDF_Evaluate(vec3 V, vec3 N, vec3 L, Material material, vec3 Cdlin) {
     return diffuse * (1.0f - material.metallic) + specular + clearcoat;
 }
 
+
+//==========================================sampling==========================================//
+
+// 以 N 为 z 轴建立局部坐标系
+void buildBasis(vec3 N, vec3& T, vec3& B) {
+    vec3 up = fabs(N.z) < 0.999f ? vec3(0, 0, 1) : vec3(1, 0, 0);
+    T = normalize(cross(up, N));
+    B = cross(N, T);
+}
+
+// 三个波瓣被选中的概率：漫反射按 (1 - metallic)，镜面固定为 1，清漆按 BRDF_Evaluate 里的 0.25 * clearcoat，再归一化
+void BRDF_LobeWeights(const Material& material, float& pDiffuse, float& pSpecular, float& pClearcoat) {
+    pDiffuse = 1.0f - material.metallic;
+    pSpecular = 1.0f;
+    pClearcoat = 0.25f * material.clearcoat;
+    float sum = pDiffuse + pSpecular + pClearcoat;
+    pDiffuse /= sum;
+    pSpecular /= sum;
+    pClearcoat /= sum;
+}
+
+// 按 BRDF_Evaluate 的各个波瓣做重要性采样：漫反射按余弦，镜面按 GTR2，清漆按 GTR1 采样半程向量。
+// V 是入射方向的负方向，返回反弹方向 L，它的概率密度由 BRDF_Pdf 给出（可能在表面以下，此时概率密度为 0）
+vec3 BRDF_Sample(vec3 V, vec3 N, const Material& material) {
+    float pDiffuse, pSpecular, pClearcoat;
+    BRDF_LobeWeights(material, pDiffuse, pSpecular, pClearcoat);
+    vec3 T, B;
+    buildBasis(N, T, B);
+
+    double u, v;
+    float r = sample1D();
+    sample2D(u, v);
+    float u1 = u;
+    float phi = 2.0f * PI * v;
+    if (r < pDiffuse) {
+        float sinTheta = sqrt(u1);
+        return normalize(T * (sinTheta * cos(phi)) + B * (sinTheta * sin(phi)) + N * sqrt(1.0f - u1));
+    }
+
+    float cosTheta;
+    if (r < pDiffuse + pSpecular) {
+        float a2 = sqr(max(0.001, sqr(material.roughness)));
+        cosTheta = sqrt((1.0f - u1) / (1.0f + (a2 - 1.0f) * u1));
+    } else {
+        float a2 = sqr(mix(0.1, 0.001, material.clearcoatGloss));
+        cosTheta = sqrt((1.0f - pow(a2, 1.0f - u1)) / (1.0f - a2));
+    }
+    float sinTheta = sqrt(max(0.0f, 1.0f - cosTheta * cosTheta));
+    vec3 H = T * (sinTheta * cos(phi)) + B * (sinTheta * sin(phi)) + N * cosTheta;
+    return normalize(reflect(-V, H));
+}
+
+// BRDF_Sample 采样到 L 的概率密度（立体角），是三个波瓣概率密度按选择概率的加权和
+float BRDF_Pdf(vec3 V, vec3 N, vec3 L, const Material& material) {
+    float NdotL = dot(N, L);
+    float NdotV = dot(N, V);
+    if(NdotL <= 0 || NdotV < 0) return 0;
+
+    float pDiffuse, pSpecular, pClearcoat;
+    BRDF_LobeWeights(material, pDiffuse, pSpecular, pClearcoat);
+
+    vec3 H = normalize(L + V);
+    float NdotH = dot(N, H);
+    float LdotH = max(dot(L, H), 1e-6f);
+
+    float pdfDiffuse = NdotL * PI_INV;
+    float pdfSpecular = GTR2(NdotH, max(0.001, sqr(material.roughness))) * NdotH / (4.0f * LdotH);
+    float pdfClearcoat = GTR1(NdotH, mix(0.1, 0.001, material.clearcoatGloss)) * NdotH / (4.0f * LdotH);
+    return pDiffuse * pdfDiffuse + pSpecular * pdfSpecular + pClearcoat * pdfClearcoat;
+}
+
+// 新方案中材质按折射处理的比例（折射光占比减去反射光占比），其余部分按 BRDF 反射
+float transmitRate(const Material& material) {
+    return std::min(1.0f, std::max(0.0f, float(material.refractRate - material.specularRate)));
+}
+
+// 多重重要性采样的幂启发式（β = 2），a 为当前策略的概率密度，b 为另一种策略的
+float powerHeuristic(float a, float b) {
+    if (a <= 0) return 0;
+    return a * a / (a * a + b * b);
+}
@@ -2,26 +2,53 @@
 #include "shape.h"
 #include "bvh.h"
 #include "texture.h"
+#include "mapped_file.h"
+#include "obj_parser.h"
 #include <bits/stdc++.h>
 #include "../externals/glm/gtc/matrix_transform.hpp"
 #include "../externals/tiny_obj_loader.h"
 #include <iostream>
 
+// BVH 缓存文件的格式版本，文件布局或构建算法改变时加一，旧的缓存会因为 key 不同而失效
+const uint32_t MESH_CACHE_VERSION = 5;
+
+// 缓存文件依次存放：文件头、顶点位置、顶点法向量、纹理坐标、BVH 顺序的三角形下标、二叉 BVH 节点、多叉 BVH 节点
+struct MeshCacheHeader {
+    char magic[8];
+    uint64_t key;
+    uint32_t version;
+    int32_t vertices;
+    int32_t normals;
+    int32_t uvs;
+    int32_t triangles;
+    int32_t nodes;
+    int32_t wideNodes;
+    uint64_t objSize;   // OBJ 文件的字节数，和 key 一起校验
+    uint64_t objHash;   // 只由 OBJ 内容得到的哈希，用来判断同名的旧缓存是否已经过时
+};
+
+// 索引三角形网格：所有三角形共用一份顶点 / 法向量 / 纹理坐标数组和一个材质，
+// 三角形只是 indices 中的 3 个下标，BVH 叶子按三角形下标引用
 class Mesh: public Shape {
 public:
     Mesh() {
 
     }
 
-    std::vector <vec3> vertices;
-    std::vector <vec3> n;
-    std::vector <int> indices;
+    std::vector <vec3> vertices;        // 顶点位置（已做模型变换）
+    std::vector <vec3> n;               // 顶点法向量，smooth 时才有，与 vertices 一一对应
+    std::vector <vec2> uv;              // 顶点纹理坐标，文件中每个角都给了 vt 时才有
+    std::vector <uint32_t> indices;     // 每 3 个一组为一个三角形，按 BVH 叶子的顺序排列
     glm::mat4 trans;
 
-    std::vector<Triangle> t;
-    BVHNode* root;
-    Material material;
+    std::vector<LinearBVHNode> nodes;
+    std::vector<WideBVHNode> wide;      // 由 nodes 合并得到的多叉 BVH，遍历时使用
+    TriangleSoA soa;    // 求交用的 SoA 几何数据，下标与 indices 中的三角形一致
+    Material material;  // 整个网格共用的材质
     bool bruteForce = false;
+    double buildTime = 0;   // BVH 构建耗时（毫秒）
+
+    int triangleCount() const { return (int) indices.size() / 3; }
 
     // 模型变换矩阵
     mat4 getTransformMatrix(vec3 rotateCtrl, vec3 translateCtrl, vec3 scaleCtrl) {
@@ -42,186 +69,404 @@ public:
         return model;
     }
     
-    struct TriangleIndex {
-        TriangleIndex() {
-            x[0] = 0;
-            x[1] = 0;
-            x[2] = 0;
+    bool intersect(const Ray& ray, HitRecord& rec) override {
+        bool hit = false;
+        if(bruteForce){
+            hit = hitTriangleSoA(ray, soa, 0, soa.count, rec);
+        }
+        else
+            hit = hitBVH(ray, soa, wide, rec);
+        if (hit) rec.shape = this;
+        return hit;
+    }
+
+    // 和 Triangle::resolve 相同，只是顶点从共享数组中按下标取出，材质指向整个网格共用的 material
+    void resolve(const Ray& ray, const HitRecord& rec, HitResult& res) override {
+        const uint32_t* id = &indices[rec.primID * 3];
+        vec3 p1 = vertices[id[0]], p2 = vertices[id[1]], p3 = vertices[id[2]];
+        vec3 N = normalize(cross(p2 - p1, p3 - p1));
+        bool isInside = false;
+        if (dot(N, ray.direction) > 0.0f) {
+            N = -N;
+            isInside = true;
         }
 
-        int &operator[](const int i) { return x[i]; }
+        //重心坐标系的三个参数(u,v,w)分别对应 p1, p2, p3
+        float u = 1.0f - rec.u - rec.v;
+        float v = rec.u;
+        float w = rec.v;
 
-        // By Computer Graphics convention, counterclockwise winding is front face
-        int x[3]{};
-    };
+        res.isHit = true;
+        res.distance = rec.distance;
+        res.hitPoint = ray.startPoint + ray.direction * rec.distance;
+        res.material = &material;
+        res.time = rec.time;
 
-    HitResult intersect(Ray ray) {
-        if(bruteForce){
-            HitResult res;
-            for (int i = 0; i < (int) t.size(); ++i) {
-                HitResult r = t[i].intersect(ray);
-                if(r.isHit && r.distance < res.distance) {
-                    res = r;
-                }
-            }
-            return res;
+        // 有纹理坐标时插值得到，否则和 Triangle 一样直接用重心坐标
+        vec2 st = uv.empty() ? vec2(u, v) : u * uv[id[0]] + v * uv[id[1]] + w * uv[id[2]];
+
+        if(material.normalMap.pic){
+            res.normal = normalize(material.normalMap.getColor(st.x, st.y) * 2.0f - vec3(1,1,1));
+            if(isInside)
+                res.normal = -res.normal;
+        }else if(!n.empty()){
+            // smooth 时按重心坐标插值顶点法向量，和几何法向量一样翻到光线来的一侧
+            res.normal = normalize(u * n[id[0]] + v * n[id[1]] + w * n[id[2]]);
+            if(isInside)
+                res.normal = -res.normal;
+        }else{
+            res.normal = N;
         }
+
+        if(material.texture.pic)
+            res.hitColor = material.texture.getColor(st.x, st.y);
         else
-            return hitBVH(ray, t, root);
+            res.hitColor = material.color;
+    }
+
+    bool getBounds(vec3& AA, vec3& BB) override {
+        if (!nodes.empty()) {
+            AA = nodes[0].AA;
+            BB = nodes[0].BB;
+            return true;
+        }
+        if (indices.empty()) return false;
+        AA = vec3(INF, INF, INF);
+        BB = vec3(-INF, -INF, -INF);
+        for (uint32_t id: indices) {
+            AA = min(AA, vertices[id]);
+            BB = max(BB, vertices[id]);
+        }
+        return true;
+    }
+
+    bool occluded(Ray ray, float tMax) override {
+        if(bruteForce)
+            return occludedTriangleSoA(ray, soa, 0, soa.count, tMax);
+        else
+            return occludedBVH(ray, soa, wide, tMax);
+    }
+
+    // 缓存的 key：OBJ 文件内容的哈希、模型变换和所有影响构建结果的参数
+    uint64_t cacheKey(uint64_t objHash, bool smooth, BVHBuildType bvhType, int leafSize) {
+        uint64_t key = hashBytes(&trans, sizeof(trans), objHash);
+        int params[] = {(int) MESH_CACHE_VERSION, smooth, (int) bvhType, leafSize, BVH_WIDTH, (int) sizeof(WideBVHNode)};
+        return hashBytes(params, sizeof(params), key);
+    }
+
+    // 缓存放在 OBJ 旁边，文件名带上 key，同一个模型用不同的变换或参数时互不覆盖
+    std::string cachePath(const char* filename, uint64_t key) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), ".%016llx.bvhcache", (unsigned long long) key);
+        return std::string(filename) + buf;
+    }
+
+    // 按 header 中的元素个数从 p 读出一个数组，p 前进到下一段
+    template <typename T>
+    static void readArray(const char*& p, int count, std::vector<T>& out) {
+        out.resize(count);
+        memcpy(out.data(), p, count * sizeof(T));
+        p += count * sizeof(T);
+    }
+
+    bool loadCache(const std::string& path, uint64_t key, uint64_t objSize) {
+        MappedFile file(path.c_str());
+        if (!file.isOpen() || file.size < sizeof(MeshCacheHeader)) return false;
+
+        MeshCacheHeader header;
+        memcpy(&header, file.data, sizeof(header));
+        if (memcmp(header.magic, "RTBVHC\0\0", 8) != 0 || header.version != MESH_CACHE_VERSION || header.key != key ||
+            header.objSize != objSize)
+            return false;
+        size_t expected = sizeof(header) + (header.vertices + header.normals) * sizeof(vec3) + header.uvs * sizeof(vec2) +
+                          header.triangles * 3 * sizeof(uint32_t) +
+                          header.nodes * sizeof(LinearBVHNode) + header.wideNodes * sizeof(WideBVHNode);
+        if (file.size != expected) return false;
+
+        const char* p = file.data + sizeof(header);
+        readArray(p, header.vertices, vertices);
+        readArray(p, header.normals, n);
+        readArray(p, header.uvs, uv);
+        readArray(p, header.triangles * 3, indices);
+        readArray(p, header.nodes, nodes);
+        readArray(p, header.wideNodes, wide);
+        soa.build(vertices, indices);
+        return true;
+    }
+
+    // 先写临时文件再改名，多个进程同时渲染同一个模型时不会读到写了一半的缓存
+    void saveCache(const std::string& path, uint64_t key, uint64_t objSize, uint64_t objHash) {
+        std::string tmp = path + ".tmp";
+        FILE* fp = fopen(tmp.c_str(), "wb");
+        if (!fp) return;
+
+        MeshCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "RTBVHC\0\0", 8);
+        header.key = key;
+        header.version = MESH_CACHE_VERSION;
+        header.vertices = (int32_t) vertices.size();
+        header.normals = (int32_t) n.size();
+        header.uvs = (int32_t) uv.size();
+        header.triangles = (int32_t) triangleCount();
+        header.nodes = (int32_t) nodes.size();
+        header.wideNodes = (int32_t) wide.size();
+        header.objSize = objSize;
+        header.objHash = objHash;
+        fwrite(&header, sizeof(header), 1, fp);
+
+        fwrite(vertices.data(), sizeof(vec3), vertices.size(), fp);
+        fwrite(n.data(), sizeof(vec3), n.size(), fp);
+        fwrite(uv.data(), sizeof(vec2), uv.size(), fp);
+        fwrite(indices.data(), sizeof(uint32_t), indices.size(), fp);
+        fwrite(nodes.data(), sizeof(LinearBVHNode), nodes.size(), fp);
+        fwrite(wide.data(), sizeof(WideBVHNode), wide.size(), fp);
+        bool ok = !ferror(fp);
+        fclose(fp);
+        if (!ok || rename(tmp.c_str(), path.c_str()) != 0) remove(tmp.c_str());
+    }
+
+    // 删除同一个 OBJ 旁边再也不会命中的缓存：OBJ 内容已经改变，或者是旧版本格式写的。
+    // 内容相同、只是模型变换或构建参数不同的缓存仍然有效，保留
+    void removeStaleCaches(const char* filename, uint64_t objHash) {
+        namespace fs = std::filesystem;
+        fs::path obj(filename);
+        fs::path dir = obj.has_parent_path() ? obj.parent_path() : fs::path(".");
+        std::string prefix = obj.filename().string() + ".";
+        const std::string suffix = ".bvhcache";
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(dir, ec)) {
+            std::string name = entry.path().filename().string();
+            if (name.size() != prefix.size() + 16 + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+                name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+                continue;
+            MeshCacheHeader header;
+            FILE* fp = fopen(entry.path().string().c_str(), "rb");
+            if (!fp) continue;
+            bool ok = fread(&header, sizeof(header), 1, fp) == 1;
+            fclose(fp);
+            if (ok && memcmp(header.magic, "RTBVHC\0\0", 8) == 0 && header.version == MESH_CACHE_VERSION &&
+                header.objHash == objHash)
+                continue;
+            fs::remove(entry.path(), ec);
+        }
     }
 
     Mesh(const char *filename, vec3 c, vec3 rotateCtrl, vec3 translateCtrl, vec3 scaleCtrl,
-            bool bruteForce = false, bool smooth=false, const char* texturefile="", const char* normfile="") : bruteForce(bruteForce) {
+            bool bruteForce = false, bool smooth=false, const char* texturefile="", const char* normfile="",
+            BVHBuildType bvhType = BVH_SAH, int leafSize = 8, bool useCache = true) : bruteForce(bruteForce) {
         trans = getTransformMatrix(rotateCtrl, translateCtrl, scaleCtrl);
-        std::ifstream f;
-        f.open(filename);
-        if (!f.is_open()) {
+        MappedFile file(filename);
+        if (!file.isOpen()) {
             std::cout << "Cannot open " << filename << "\n";
             return;
         }
-        std::string line;
-        std::string vTok("v");
-        std::string fTok("f");
-        std::string texTok("vt");
-        char bslash = '/', space = ' ';
-        std::string tok;
-        int texID;
-
-        float maxx = -INF;
-        float maxy = -INF;
-        float maxz = -INF;
-        float minx = INF;
-        float miny = INF;
-        float minz = INF;
 
-        Material m = Material();
-        m.color = c;
+        material = Material();
+        material.color = c;
 
         if(strlen(texturefile) > 0){
-            m.texture = Texture(texturefile);
+            material.texture = Texture(texturefile);
         }
         if(strlen(normfile) > 0){
-            m.normalMap = Texture(normfile);
+            material.normalMap = Texture(normfile);
         }
 
-        while (true) {
-            std::getline(f, line);
-            if (f.eof()) {
-                break;
-            }
-            if (line.size() < 3) {
-                continue;
-            }
-            if (line.at(0) == 'f') {
-                break;
-            }
-            if (line.at(0) == '#') {
-                continue;
-            }
-            std::stringstream ss(line);
-            ss >> tok;
-            if (tok == vTok) {
-                // 读取顶点
-                vec3 vec;
-                ss >> vec[0] >> vec[1] >> vec[2];
-                maxx = max(maxx, vec[0]);
-                maxy = max(maxx, vec[1]);
-                maxz = max(maxx, vec[2]);
-                minx = min(minx, vec[0]);
-                miny = min(minx, vec[1]);
-                minz = min(minx, vec[2]);
-                vertices.push_back(vec);
-                if(smooth)
-                    n.push_back(vec3(0, 0, 0));
+        // 命中缓存时跳过解析和 BVH 构建
+        uint64_t key = 0, objHash = 0, objSize = file.size;
+        std::string cacheFile;
+        if (useCache && !bruteForce) {
+            auto start = std::chrono::steady_clock::now();
+            objHash = hashBytes(file.data, file.size);
+            key = cacheKey(objHash, smooth, bvhType, leafSize);
+            cacheFile = cachePath(filename, key);
+            if (loadCache(cacheFile, key, objSize)) {
+                buildTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                printf("Loaded BVH cache %s: %d triangles, %d nodes in %.1f ms\n", cacheFile.c_str(), triangleCount(), (int) nodes.size(), buildTime);
+                return;
             }
         }
 
+        ObjData obj;
+        if (!parseObj(file.data, file.size, obj)) {
+            printf("Invalid number or face index in %s\n", filename);
+            exit(-1);
+        }
+        file.close();
+        std::vector<vec3>& positions = obj.positions;
+
+        float maxx = -INF;
+        float maxy = -INF;
+        float maxz = -INF;
+        float minx = INF;
+        float miny = INF;
+        float minz = INF;
+        for (auto& vec : positions) {
+            maxx = max(maxx, vec[0]);
+            maxy = max(maxx, vec[1]);
+            maxz = max(maxx, vec[2]);
+            minx = min(minx, vec[0]);
+            miny = min(minx, vec[1]);
+            minz = min(minx, vec[2]);
+        }
+
         // 模型大小归一化
         float lenx = maxx - minx;
         float leny = maxy - miny;
         float lenz = maxz - minz;
         float maxaxis = max(lenx, max(leny, lenz));
-        for (auto& vt : vertices) {
+        for (auto& vt : positions) {
             vt.x /= maxaxis;
             vt.y /= maxaxis;
             vt.z /= maxaxis;
         }
 
         // 通过矩阵进行坐标变换
-        for (auto& vt : vertices) {
+        for (auto& vt : positions) {
             vec4 vv = vec4(vt.x, vt.y, vt.z, 1);
             vv = trans * vv;
             vt = vec3(vv.x, vv.y, vv.z);
         }
 
-        while(true){
-            std::getline(f, line);
-            if (f.eof()) {
-                break;
+        // 每个角都给了 vt / vn 时才使用文件中的纹理坐标 / 法向量
+        bool fileUV = !obj.texcoords.empty();
+        bool fileNormals = smooth && !obj.normals.empty();
+        for (auto& corner : obj.corners) {
+            if (corner.vt < 0) fileUV = false;
+            if (corner.vn < 0) fileNormals = false;
+        }
+
+        // 平滑法向量：没有文件法向量时用相邻面法向量的平均，按位置下标累加
+        std::vector<vec3> averaged;
+        if (smooth && !fileNormals) {
+            averaged.assign(positions.size(), vec3(0, 0, 0));
+            for (size_t i = 0; i + 2 < obj.corners.size(); i += 3) {
+                int id[3] = {obj.corners[i].v, obj.corners[i + 1].v, obj.corners[i + 2].v};
+                vec3 norm = normalize(cross(positions[id[1]] - positions[id[0]], positions[id[2]] - positions[id[0]]));
+                averaged[id[0]] += norm;
+                averaged[id[1]] += norm;
+                averaged[id[2]] += norm;
             }
-            if (line.at(0) == '#') {
-                continue;
+            for (auto &norm: averaged) {
+                norm = normalize(norm);
             }
-            std::stringstream ss(line);
-            ss >> tok;
+        }
 
-            if (tok == vTok) {
-                exit(-1);
+        indices.resize(obj.corners.size());
+        if (!fileUV && !fileNormals) {
+            // 顶点属性只跟位置有关，直接用位置数组作为顶点数组
+            for (size_t i = 0; i < obj.corners.size(); i++) {
+                indices[i] = (uint32_t) obj.corners[i].v;
             }
-            else if (tok == fTok) {
-                // 读取面
-                if (line.find(bslash) != std::string::npos) { // 有纹理坐标
-                    std::replace(line.begin(), line.end(), bslash, space);
-                    std::stringstream facess(line);
-                    TriangleIndex trig;
-                    facess >> tok;
-                    for (int ii = 0; ii < 3; ii++) {
-                        facess >> trig[ii] >> texID;
-                        trig[ii]--;
-                    }
-                    if(smooth) {
-                        vec3 norm = normalize(
-                                cross(vertices[trig[1]] - vertices[trig[0]], vertices[trig[2]] - vertices[trig[0]]));
-                        n[trig[0]] += norm;
-                        n[trig[1]] += norm;
-                        n[trig[2]] += norm;
-
-                        t.push_back(Triangle(vertices[trig[0]], vertices[trig[1]], vertices[trig[2]], m, vec3(3.0f, 3.0f, 3.0f), DIFF,
-                                             trig[0], trig[1], trig[2], smooth));
-                    }
-                    else{
-                        t.push_back(Triangle(vertices[trig[0]], vertices[trig[1]], vertices[trig[2]], m));
-                    }
-                } else {
-                    TriangleIndex trig;
-                    for (int ii = 0; ii < 3; ii++) {
-                        t.push_back(Triangle(vertices[trig[0]], vertices[trig[1]], vertices[trig[2]], m));
-                    }
+            vertices.swap(positions);
+            n.swap(averaged);
+        } else {
+            // 同一个位置在不同的面上可能配不同的 vt / vn，这样的角拆成不同的顶点。
+            // 同一位置的顶点串成链表，head 为链表头，按 (vt, vn) 查找已有的顶点
+            std::vector<int> head(positions.size(), -1);
+            std::vector<int> next;
+            std::vector<ObjCorner> keys;
+            for (size_t i = 0; i < obj.corners.size(); i++) {
+                ObjCorner key = obj.corners[i];
+                if (!fileUV) key.vt = -1;
+                if (!fileNormals) key.vn = -1;
+                int id = head[key.v];
+                while (id != -1 && (keys[id].vt != key.vt || keys[id].vn != key.vn)) id = next[id];
+                if (id == -1) {
+                    id = (int) keys.size();
+                    keys.push_back(key);
+                    next.push_back(head[key.v]);
+                    head[key.v] = id;
                 }
-            } else if (tok == texTok) { // 纹理坐标
-                vec2 texcoord;
-                ss >> texcoord[0];
-                ss >> texcoord[1];
+                indices[i] = (uint32_t) id;
             }
-        }
 
-        if(smooth) {
-            for (auto &norm: n) {
-                norm = normalize(norm);
+            mat4 normalMatrix = transpose(inverse(trans));
+            vertices.resize(keys.size());
+            if (fileUV) uv.resize(keys.size());
+            if (smooth) n.resize(keys.size());
+            for (size_t i = 0; i < keys.size(); i++) {
+                vertices[i] = positions[keys[i].v];
+                if (fileUV) uv[i] = obj.texcoords[keys[i].vt];
+                if (fileNormals) {
+                    vec3 fn = obj.normals[keys[i].vn];
+                    vec4 nn = normalMatrix * vec4(fn.x, fn.y, fn.z, 0);
+                    n[i] = normalize(vec3(nn.x, nn.y, nn.z));
+                } else if (smooth) {
+                    n[i] = averaged[keys[i].v];
+                }
             }
+        }
+        std::vector<ObjCorner>().swap(obj.corners); // 下标已经转换完，尽早释放
 
-            for (auto &tri: t) {
-                tri.n1 = n[tri.id1];
-                tri.n2 = n[tri.id2];
-                tri.n3 = n[tri.id3];
+        if(!bruteForce) {
+            auto start = std::chrono::steady_clock::now();
+            nodes = buildLinearBVH(vertices, indices, bvhType, leafSize);
+            wide = buildWideBVH(nodes);
+            soa.build(vertices, indices);
+            buildTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            printf("Built BVH for %s: %d triangles, %d nodes in %.1f ms\n", filename, triangleCount(), (int) nodes.size(), buildTime);
+            if (!cacheFile.empty()) {
+                removeStaleCaches(filename, objHash);
+                saveCache(cacheFile, key, objSize, objHash);
             }
+        } else {
+            soa.build(vertices, indices);
         }
+    }
+};
 
-        material.color = c;
-        if(bruteForce)
-            root = nullptr;
-        else
-            root = buildBVH(t, 0, t.size() - 1, 8);
-        f.close();
+// 网格实例：引用一个共享的 Mesh（几何数据和 BVH 只有一份），只保存自己的模型变换。
+// 求交时把光线变换到 Mesh 的物体空间；方向不做归一化，两个空间里的 t 相同，可以直接和 rec.distance 比较
+class Instance : public Shape {
+public:
+    Mesh* mesh;
+    mat4 transform;     // 物体空间到世界空间
+    mat4 inv;           // 世界空间到物体空间
+    mat4 normalMatrix;  // 法向量的变换：transform 逆矩阵的转置
+
+    // 变换参数和 Mesh 的构造函数含义相同，作用在 Mesh 已经变换过的顶点上
+    Instance(Mesh* mesh, vec3 rotateCtrl, vec3 translateCtrl, vec3 scaleCtrl) : mesh(mesh) {
+        transform = mesh->getTransformMatrix(rotateCtrl, translateCtrl, scaleCtrl);
+        inv = inverse(transform);
+        normalMatrix = transpose(inv);
+    }
+
+    Ray toObject(const Ray& ray) const {
+        vec4 o = inv * vec4(ray.startPoint.x, ray.startPoint.y, ray.startPoint.z, 1);
+        vec4 d = inv * vec4(ray.direction.x, ray.direction.y, ray.direction.z, 0);
+        return Ray(vec3(o.x, o.y, o.z), vec3(d.x, d.y, d.z), ray.time);
+    }
+
+    bool intersect(const Ray& ray, HitRecord& rec) override {
+        if (!mesh->intersect(toObject(ray), rec)) return false;
+        rec.shape = this;
+        return true;
+    }
+
+    // 在物体空间还原表面信息，再把命中点和法向量变换回世界空间
+    void resolve(const Ray& ray, const HitRecord& rec, HitResult& res) override {
+        mesh->resolve(toObject(ray), rec, res);
+        res.hitPoint = ray.startPoint + ray.direction * rec.distance;
+        vec4 nn = normalMatrix * vec4(res.normal.x, res.normal.y, res.normal.z, 0);
+        res.normal = normalize(vec3(nn.x, nn.y, nn.z));
+    }
+
+    bool occluded(Ray ray, float tMax) override {
+        return mesh->occluded(toObject(ray), tMax);
+    }
+
+    // Mesh 包围盒的 8 个角变换后的包围盒
+    bool getBounds(vec3& AA, vec3& BB) override {
+        vec3 A, B;
+        if (!mesh->getBounds(A, B)) return false;
+        AA = vec3(INF, INF, INF);
+        BB = vec3(-INF, -INF, -INF);
+        for (int i = 0; i < 8; i++) {
+            vec4 p = transform * vec4(i & 1 ? B.x : A.x, i & 2 ? B.y : A.y, i & 4 ? B.z : A.z, 1);
+            AA = min(AA, vec3(p.x, p.y, p.z));
+            BB = max(BB, vec3(p.x, p.y, p.z));
+        }
+        return true;
     }
 };
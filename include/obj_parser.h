@@ -0,0 +1,243 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <omp.h>
+#include "util.h"
+
+// OBJ 面的一个角：位置、纹理坐标、法向量在各自数组里的下标（从 0 开始），没有给出时为 -1
+struct ObjCorner {
+    int v = -1, vt = -1, vn = -1;
+};
+
+// OBJ 解析结果，多边形面已经按扇形拆成三角形，corners 中每 3 个为一个三角形
+struct ObjData {
+    std::vector<vec3> positions;
+    std::vector<vec3> normals;
+    std::vector<vec2> texcoords;
+    std::vector<ObjCorner> corners;
+};
+
+// 手写的数字扫描，不经过 locale 和 stringstream；p 为当前位置，end 为行尾
+inline void skipSpaces(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+}
+
+inline bool scanInt(const char*& p, const char* end, int& value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    if (p >= end || *p < '0' || *p > '9') return false;
+    int v = 0;
+    while (p < end && *p >= '0' && *p <= '9') v = v * 10 + (*p++ - '0');
+    value = negative ? -v : v;
+    return true;
+}
+
+// 最多保留 19 位有效数字；指数不超过 22 时 10 的幂在 double 中是精确的，结果只有一次舍入
+inline bool scanFloat(const char*& p, const char* end, float& value) {
+    static const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa) digits++;
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa) digits++;
+                exponent--;
+            }
+        }
+    }
+    if (!any) return false;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        int e;
+        if (scanInt(q, end, e)) {
+            exponent += e;
+            p = q;
+        }
+    }
+
+    double v = double(mantissa);
+    if (exponent < 0)
+        v = exponent >= -22 ? v / POW10[-exponent] : v * pow(10.0, exponent);
+    else if (exponent > 0)
+        v = exponent <= 22 ? v * POW10[exponent] : v * pow(10.0, exponent);
+    value = float(negative ? -v : v);
+    return true;
+}
+
+// 一段文本的解析结果。负的（相对）下标要等知道前面各段有多少个元素后才能换算成全局下标，
+// 先记为段内下标，并在 relative 中标记：第 0/1/2 位分别对应 v / vt / vn。
+// 遇到写错的数字或面下标时 valid 置为 false
+struct ObjChunk {
+    std::vector<vec3> positions;
+    std::vector<vec3> normals;
+    std::vector<vec2> texcoords;
+    std::vector<ObjCorner> corners;
+    std::vector<uint8_t> relative;
+    bool valid = true;
+};
+
+// 解析一个 f 记录里的一个角，支持 v、v/vt、v//vn、v/vt/vn 四种写法
+inline bool scanCorner(const char*& p, const char* end, const ObjChunk& chunk, ObjCorner& corner, uint8_t& relative) {
+    int index;
+    relative = 0;
+    if (!scanInt(p, end, index) || index == 0) return false;
+    corner.v = index > 0 ? index - 1 : (int) chunk.positions.size() + index;
+    if (index < 0) relative |= 1;
+    if (p < end && *p == '/') {
+        p++;
+        if (p < end && *p != '/') {
+            if (!scanInt(p, end, index) || index == 0) return false;
+            corner.vt = index > 0 ? index - 1 : (int) chunk.texcoords.size() + index;
+            if (index < 0) relative |= 2;
+        }
+        if (p < end && *p == '/') {
+            p++;
+            if (!scanInt(p, end, index) || index == 0) return false;
+            corner.vn = index > 0 ? index - 1 : (int) chunk.normals.size() + index;
+            if (index < 0) relative |= 4;
+        }
+    }
+    return true;
+}
+
+// 解析从行首 begin 开始到 end 的若干整行，其他记录（o、g、usemtl、注释等）直接跳过
+void parseObjChunk(const char* begin, const char* end, ObjChunk& chunk) {
+    std::vector<ObjCorner> polygon;
+    std::vector<uint8_t> polygonRelative;
+    const char* p = begin;
+    while (p < end) {
+        const char* lineEnd = (const char*) memchr(p, '\n', end - p);
+        if (!lineEnd) lineEnd = end;
+        skipSpaces(p, lineEnd);
+
+        if (lineEnd - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            vec3 v(0.0f);
+            p++;
+            for (int i = 0; i < 3; i++) {
+                skipSpaces(p, lineEnd);
+                if (!scanFloat(p, lineEnd, v[i])) chunk.valid = false;
+            }
+            chunk.positions.push_back(v);
+        } else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) {
+            vec3 n(0.0f);
+            p += 2;
+            for (int i = 0; i < 3; i++) {
+                skipSpaces(p, lineEnd);
+                if (!scanFloat(p, lineEnd, n[i])) chunk.valid = false;
+            }
+            chunk.normals.push_back(n);
+        } else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t')) {
+            vec2 uv(0.0f);
+            p += 2;
+            for (int i = 0; i < 2; i++) {
+                skipSpaces(p, lineEnd);
+                // vt 的第二个分量可以省略，默认为 0
+                if (i == 1 && (p >= lineEnd || *p == '#')) break;
+                if (!scanFloat(p, lineEnd, uv[i])) chunk.valid = false;
+            }
+            chunk.texcoords.push_back(uv);
+        } else if (lineEnd - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            polygon.clear();
+            polygonRelative.clear();
+            p++;
+            while (true) {
+                skipSpaces(p, lineEnd);
+                if (p >= lineEnd || *p == '#') break;
+                ObjCorner corner;
+                uint8_t relative;
+                if (!scanCorner(p, lineEnd, chunk, corner, relative)) {
+                    chunk.valid = false;
+                    break;
+                }
+                polygon.push_back(corner);
+                polygonRelative.push_back(relative);
+            }
+            // 按扇形拆成三角形
+            for (int i = 1; i + 1 < (int) polygon.size(); i++) {
+                int fan[3] = {0, i, i + 1};
+                for (int k: fan) {
+                    chunk.corners.push_back(polygon[k]);
+                    chunk.relative.push_back(polygonRelative[k]);
+                }
+            }
+        }
+        p = lineEnd + 1;
+    }
+}
+
+// 把整个文件按行边界切成若干段并行解析，再按段的顺序合并，换算相对下标。
+// 数字或面下标写错、面引用了不存在的顶点时返回 false
+bool parseObj(const char* data, size_t size, ObjData& obj) {
+    int threads = omp_get_max_threads();
+    const size_t MIN_CHUNK = 1 << 16;
+    int chunkCount = (int) std::max<size_t>(1, std::min<size_t>(threads * 4, size / MIN_CHUNK));
+
+    // 每段从 size * c / chunkCount 之后的第一个行首开始
+    std::vector<const char*> bounds(chunkCount + 1);
+    bounds[0] = data;
+    bounds[chunkCount] = data + size;
+    for (int c = 1; c < chunkCount; c++) {
+        const char* p = data + size * c / chunkCount;
+        const char* lineEnd = (const char*) memchr(p, '\n', data + size - p);
+        bounds[c] = lineEnd ? std::max(lineEnd + 1, bounds[c - 1]) : data + size;
+    }
+
+    std::vector<ObjChunk> chunks(chunkCount);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int c = 0; c < chunkCount; c++) {
+        parseObjChunk(bounds[c], std::max(bounds[c], bounds[c + 1]), chunks[c]);
+    }
+
+    // 各段在合并后数组中的起始位置
+    std::vector<size_t> pBase(chunkCount + 1, 0), nBase(chunkCount + 1, 0), tBase(chunkCount + 1, 0), cBase(chunkCount + 1, 0);
+    for (int c = 0; c < chunkCount; c++) {
+        pBase[c + 1] = pBase[c] + chunks[c].positions.size();
+        nBase[c + 1] = nBase[c] + chunks[c].normals.size();
+        tBase[c + 1] = tBase[c] + chunks[c].texcoords.size();
+        cBase[c + 1] = cBase[c] + chunks[c].corners.size();
+    }
+    obj.positions.resize(pBase[chunkCount]);
+    obj.normals.resize(nBase[chunkCount]);
+    obj.texcoords.resize(tBase[chunkCount]);
+    obj.corners.resize(cBase[chunkCount]);
+
+    bool valid = true;
+#pragma omp parallel for schedule(dynamic, 1) reduction(&&: valid)
+    for (int c = 0; c < chunkCount; c++) {
+        ObjChunk& chunk = chunks[c];
+        if (!chunk.valid) valid = false;
+        std::copy(chunk.positions.begin(), chunk.positions.end(), obj.positions.begin() + pBase[c]);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), obj.normals.begin() + nBase[c]);
+        std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), obj.texcoords.begin() + tBase[c]);
+        for (size_t i = 0; i < chunk.corners.size(); i++) {
+            ObjCorner corner = chunk.corners[i];
+            if (chunk.relative[i] & 1) corner.v += (int) pBase[c];
+            if (chunk.relative[i] & 2) corner.vt += (int) tBase[c];
+            if (chunk.relative[i] & 4) corner.vn += (int) nBase[c];
+            if (corner.v < 0 || corner.v >= (int) obj.positions.size()) valid = false;
+            // 有些导出工具会写出指向不存在的 vt / vn 的下标，这里当作没有给出
+            if (corner.vt < 0 || corner.vt >= (int) obj.texcoords.size()) corner.vt = -1;
+            if (corner.vn < 0 || corner.vn >= (int) obj.normals.size()) corner.vn = -1;
+            obj.corners[cBase[c] + i] = corner;
+        }
+        chunk = ObjChunk(); // 合并后尽早释放
+    }
+    return valid;
+}
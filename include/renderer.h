@@ -8,34 +8,53 @@
 #include "shape.h"
 #include "material.h"
 #include "scene.h"
+#include "scene_bvh.h"
+#include "light_sampler.h"
 #include "camera.h"
 
 using namespace std;
 
-HitResult shoot(vector<Shape *> &shapes, Ray ray) {
-    HitResult res, r;
-    for (auto &shape: shapes) {
-        r = shape->intersect(ray);
-        if (r.isHit && r.distance < res.distance) res = r;
-    }
-    return res;
+HitResult shoot(SceneBVH &accel, Ray ray) {
+    return accel.intersect(ray);
+}
+
+// 阴影光线：tMax 之前是否有任何物体遮挡
+bool occluded(SceneBVH &accel, Ray ray, float tMax) {
+    return accel.occluded(ray, tMax);
 }
 
 class SimpleRenderer{
 public:
-
-    vec3 pathTracingNEE(vector<Shape *> &shapes, Ray ray, int depth, vector<Triangle *> &lights, Material& material, vec3 hitColor,
-                        bool legacy = true, vec3 indirect = vec3(0)) {
-
+    uint64_t seed = 0; // 随机数种子，相同的种子得到相同的图像
+    int threads = 0;   // 渲染线程数，0 表示使用全部处理器
+    int tileSize = 32; // 分块大小（像素）
+    bool throughputRoulette = false; // 俄罗斯轮盘赌按路径 throughput 而不是下一个顶点的颜色决定存活概率
+    int lightSamples = 4; // 每个着色点最多做几次光源采样；光源更多时按 lightSampling 抽取，不再逐个采样
+    LightSamplingType lightSampling = LIGHT_BVH; // 光源多时的选择方式
+    SamplerType samplerType = SAMPLER_RANDOM; // 像素内位置、镜头、时间、光源采样和反弹方向用的采样器
+    bool adaptive = false;          // 自适应采样：第一遍之后只给误差还大的块追加样本
+    double adaptiveThreshold = 0.05; // 块内像素亮度的相对标准误差平均低于它时停止追加
+    int adaptiveMaxPasses = 8;      // 每个像素最多采样几遍，每遍 samples * 4 个样本
+    double timeBudget = 0;          // 自适应采样的时间预算（秒），用完后不再开始新的一遍；0 表示不限
+    std::vector<int> sampleCounts;  // 最近一次 render 每个像素实际的样本数
+
+    // 在 ray.startPoint 处对光源采样（NEE），返回直接光照
+    vec3 sampleDirect(SceneBVH &accel, const Ray &ray, LightSampler &lights, const Material& material, vec3 normal,
+                      vec3 hitColor, bool legacy, vec3 indirect) {
         vec3 color = vec3(0);
-        vec3 normal = material.normal;
-
-        if(!legacy && indirect == vec3(0)) {
-            exit(-1);
-        }
 
-        // 对光源采样
-        for (auto &light: lights) {
+        // 光源不多时逐个采样；否则抽取 lightSamples 个，每个的贡献除以被抽中的概率
+        bool all = lights.size() <= lightSamples;
+        int count = all ? lights.size() : lightSamples;
+        for (int s = 0; s < count; s++) {
+            Triangle* light;
+            float pmf = 1.0f;
+            if (all) {
+                light = lights.lights[s];
+            } else {
+                light = lights.sample(ray.startPoint, sample1D(), pmf);
+                pmf *= count;
+            }
             LightSampleResult lsr = light->sampleLight();
             vec3 L = lsr.origin - ray.startPoint;
             double distance = length(L);
@@ -46,13 +65,14 @@ public:
             shadowRay.time = ray.time;
 
 
-            HitResult shadowRes = shoot(shapes, shadowRay);
-            if (abs(shadowRes.distance - distance) < 0.01f && shadowRes.material.isEmissive) {
+            // 光源本身位于 distance 处，留出 0.01 的余量
+            if (!occluded(accel, shadowRay, distance - 0.01f)) {
                 float cosTheta = dot(shadowRay.direction, normal);
                 float cosTheta2 = dot(shadowRay.direction, lsr.normal);
                 if (cosTheta * cosTheta2 > 0) {
                     float G = cosTheta * cosTheta2 / (distance * distance);
-                    float pdf = lsr.pdf;
+                    float pdf = lsr.pdf * pmf;
+                    float mis = 1.0f;
                     vec3 fr;
                     if(legacy) {
                         // for legacy method, we think every thing as
@@ -61,173 +81,362 @@ public:
                         // and we think every thing goes on well with Lambert
                         fr = hitColor * PI_INV;
                     } else {
-                        fr = BRDF_Evaluate(-indirect, material.normal, shadowRay.direction, material, hitColor);
+                        // 与 BRDF 采样做多重重要性采样，两种策略的概率密度都换算到立体角上
+                        float reflectRate = 1.0f - transmitRate(material);
+                        fr = reflectRate * BRDF_Evaluate(-indirect, normal, shadowRay.direction, material, hitColor);
+                        float lightPdf = pdf * distance * distance / fabs(cosTheta2);
+                        float brdfPdf = reflectRate * BRDF_Pdf(-indirect, normal, shadowRay.direction, material);
+                        mis = powerHeuristic(lightPdf, brdfPdf);
                     }
-                    float weight = 1.0 / pdf;
+                    float weight = 1.0 / pdf * mis;
                     color += fr * G * weight * lsr.erate;
                 }
             }
         }
 
-        // 普通采样
-        HitResult res = shoot(shapes, ray);
+        return color;
+    }
 
-        if (!res.isHit) return vec3(0);
+    // 在 p 处做 NEE 时采样到光源 light 上一点的概率密度（对面积），和 sampleDirect 的选择方式一致：逐个采样时选择概率为 1
+    float lightPdf(LightSampler &lights, const Shape* light, vec3 p) {
+        auto it = lights.index.find(light);
+        if (it == lights.index.end()) return 0;
+        const Triangle* tri = lights.lights[it->second];
+        float select = lights.size() <= lightSamples ? 1.0f : lightSamples * lights.pmf(p, light);
+        return select / (0.5f * length(cross(tri->e1, tri->e2)));
+    }
 
-        if (res.material.isEmissive) return color; //直接光照已经算过了，直接返回就行
+    // 迭代形式的路径追踪（legacy 方案）：每次循环处理路径上的一个顶点，throughput 是路径到当前顶点为止累积的权重。
+    // ray 从当前顶点出发，material / normal / hitColor 是当前顶点的材质、法向量和颜色
+    vec3 pathTracingNEE(SceneBVH &accel, Ray ray, int depth, LightSampler &lights, const Material& material, vec3 normal,
+                        vec3 hitColor) {
+        vec3 color = vec3(0);
+        vec3 throughput = vec3(1);
+        const Material* current = &material;
 
-        double r = randf();
+        for (;; depth++) {
+            vec3 direct = sampleDirect(accel, ray, lights, *current, normal, hitColor, true, vec3(0));
 
-        // from smallpt
-        vec3 f = res.hitColor;
-        // use maximum reflectivity amount of Russian roulette
-        float P = f.x > f.y && f.x > f.z ? f.x : f.y > f.z ? f.y : f.z; // max refl
-        P = max(P - 0.1f, 0.1f);  // P range from 0.1 to 0.9
+            // 普通采样
+            HitResult res = shoot(accel, ray);
 
-        if (depth > 4) {
-            if (r >= P)
-                return vec3(0);
-        }
+            if (!res.isHit) break;
 
-        Ray nextRay;
-        nextRay.startPoint = res.hitPoint;
-        nextRay.direction = randomDirection(res.material.normal);
-        nextRay.time = ray.time;
-
-        float cosine = fabs(dot(-ray.direction, res.material.normal));
-
-        r = randf();
-        if(!res.material.isEmissive) {
-            if(legacy) {
-                // legacy方案不是蒙特卡洛，只是用改变方向的方式模仿BRDF的效果
-                // 1/pdf is always 2*PI thanks to our living in a 3D world
-                // Lambert漫反射取rou为 1
-                // fr = rou / PI
-                // cos-weighted importance sampling pdf = cos / PI
-                // so, fr * cos / pdf = rou
-                if (r < res.material.specularRate) {
-                    vec3 ref = normalize(reflect(ray.direction, res.material.normal));
-                    nextRay.direction = ref;
-                    color += pathTracingNEE(shapes, nextRay, depth + 1, lights, res.material, res.hitColor) / P;
-                } else if (res.material.specularRate <= r && r <= res.material.refractRate) {
-                    vec3 ref = normalize(refract(ray.direction, res.material.normal, float(res.material.refractRate)));
-                    nextRay.direction = mix(ref, -nextRay.direction, res.material.refractRoughness);
-                    color += pathTracingNEE(shapes, nextRay, depth + 1, lights, res.material, res.hitColor) / P;
-                } else {
-                    vec3 srcColor = res.hitColor;
-                    vec3 ptColor = pathTracingNEE(shapes, nextRay, depth + 1, lights, res.material, res.hitColor);
-                    color += ptColor * srcColor / P;
+            if (res.material->isEmissive) { //直接光照已经算过了，直接结束
+                color += throughput * direct;
+                break;
+            }
+
+            double r = randf();
+
+            // from smallpt
+            vec3 f = res.hitColor;
+            // use maximum reflectivity amount of Russian roulette
+            float P = f.x > f.y && f.x > f.z ? f.x : f.y > f.z ? f.y : f.z; // max refl
+            P = max(P - 0.1f, 0.1f);  // P range from 0.1 to 0.9
+
+            if (throughputRoulette) {
+                // 按已累积的 throughput 决定存活概率，存活时把权重除回去
+                P = 1.0f;
+                if (depth > 4) {
+                    float q = min(max(throughput.x, max(throughput.y, throughput.z)), 0.95f);
+                    if (r >= q)
+                        break;
+                    throughput /= q;
                 }
+            } else if (depth > 4) {
+                if (r >= P)
+                    break;
             }
-            else{
-                // 这里的代码看似和上面类似，其实已经很不同了，这里是一种importance sampling的方法
-                // TODO:更加合理的importance sampling；目前这个没有按照brdf的概率来采样；但效果还行; Disney论文里其实有
-                if (r < res.material.specularRate) {
-                    vec3 ref = normalize(reflect(ray.direction, res.material.normal));
-                    nextRay.direction = mix(ref, nextRay.direction, res.material.roughness);
-                    color += pathTracingNEE(shapes, nextRay, depth + 1, lights, res.material, res.hitColor, legacy, ray.direction) * cosine / P * float(2.0f * PI/ res.material.specularRate) * BRDF_Evaluate(-indirect, material.normal, nextRay.direction, material, hitColor);
-                } else if (res.material.specularRate <= r && r <= res.material.refractRate) {
-                    vec3 ref = normalize(refract(ray.direction, res.material.normal, float(res.material.refractRate)));
-                    nextRay.direction = mix(ref, -nextRay.direction, res.material.refractRoughness);
-                    color += pathTracingNEE(shapes, nextRay, depth + 1, lights, res.material, res.hitColor, legacy, ray.direction) * cosine / P * float(2.0f * PI/ (res.material.refractRate - res.material.specularRate)) *  BRDF_Evaluate(-indirect, material.normal, nextRay.direction, material, hitColor);
+
+            color += throughput * direct;
+
+            Ray nextRay;
+            nextRay.startPoint = res.hitPoint;
+            nextRay.direction = randomDirection(res.normal);
+            nextRay.time = ray.time;
+
+            vec3 weight;
+            r = randf();
+            // legacy方案不是蒙特卡洛，只是用改变方向的方式模仿BRDF的效果
+            // 1/pdf is always 2*PI thanks to our living in a 3D world
+            // Lambert漫反射取rou为 1
+            // fr = rou / PI
+            // cos-weighted importance sampling pdf = cos / PI
+            // so, fr * cos / pdf = rou
+            if (r < res.material->specularRate) {
+                vec3 ref = normalize(reflect(ray.direction, res.normal));
+                nextRay.direction = ref;
+                weight = vec3(1.0f / P);
+            } else if (res.material->specularRate <= r && r <= res.material->refractRate) {
+                vec3 ref = normalize(refract(ray.direction, res.normal, float(res.material->refractRate)));
+                nextRay.direction = mix(ref, -nextRay.direction, res.material->refractRoughness);
+                weight = vec3(1.0f / P);
+            } else {
+                weight = res.hitColor / P;
+            }
+
+            throughput *= weight;
+            ray = nextRay;
+            current = res.material;
+            normal = res.normal;
+            hitColor = res.hitColor;
+        }
+
+        return color;
+    }
+
+    // 新方案的路径追踪：res 是相机光线 ray 的第一个交点。每个顶点按 Disney BRDF 的波瓣做重要性采样，
+    // 打到光源时与 NEE 用幂启发式做多重重要性采样；折射部分按 transmitRate 选择，当作镜面方向，不参与 MIS
+    vec3 pathTracingMIS(SceneBVH &accel, Ray ray, HitResult res, LightSampler &lights) {
+        vec3 color = vec3(0);
+        vec3 throughput = vec3(1);
+        float brdfPdf = 0;      // 到达 res 的方向由 BRDF 采样得到时的概率密度，0 表示相机光线或折射方向
+        vec3 lastNormal;        // 上一个顶点的法向量
+
+        for (int depth = 0; res.isHit; depth++) {
+            const Material& material = *res.material;
+            if (material.isEmissive) {
+                if (depth == 0) {
+                    color += res.hitColor;
+                } else if (brdfPdf == 0) {
+                    color += throughput * material.erate;
                 } else {
-                    vec3 srcColor = res.hitColor;
-                    vec3 ptColor = pathTracingNEE(shapes, nextRay, depth + 1, lights, res.material, res.hitColor, legacy, ray.direction) * cosine * float(2.0f * PI/ (1 - res.material.refractRate))* BRDF_Evaluate(-indirect, material.normal, nextRay.direction, material, hitColor);
-                    color += ptColor * srcColor / P;
+                    // 和 sampleDirect 的判断一致：光源与上一个顶点互相可见的一面才计入
+                    float cosLight = dot(ray.direction, material.normal);
+                    if (dot(ray.direction, lastNormal) * cosLight > 0) {
+                        float pdf = lightPdf(lights, res.shape, ray.startPoint) * res.distance * res.distance / fabs(cosLight);
+                        color += throughput * material.erate * powerHeuristic(brdfPdf, pdf);
+                    }
                 }
+                break; // 光源不反射
+            }
+
+            vec3 V = -ray.direction;
+            vec3 N = dot(res.normal, V) < 0 ? -res.normal : res.normal;
+            float transmit = transmitRate(material);
+
+            Ray indirectRay = ray;
+            indirectRay.startPoint = res.hitPoint;
+            color += throughput * sampleDirect(accel, indirectRay, lights, material, N, res.hitColor, false, ray.direction);
+
+            // 俄罗斯轮盘赌，存活时把权重除回去
+            if (depth > 4) {
+                vec3 f = res.hitColor;
+                float q = throughputRoulette ? max(throughput.x, max(throughput.y, throughput.z)) : max(f.x, max(f.y, f.z));
+                q = min(max(q, 0.1f), 0.95f);
+                if (sample1D() >= q) break;
+                throughput /= q;
             }
+
+            Ray nextRay;
+            nextRay.startPoint = res.hitPoint;
+            nextRay.time = ray.time;
+            if (sample1D() < transmit) {
+                vec3 ref = normalize(refract(ray.direction, res.normal, float(material.refractRate)));
+                nextRay.direction = mix(ref, -randomDirection(res.normal), material.refractRoughness);
+                brdfPdf = 0;
+            } else {
+                // 选择概率 1 - transmit 与 BRDF 前面的同一个系数抵消
+                nextRay.direction = BRDF_Sample(V, N, material);
+                float pdf = BRDF_Pdf(V, N, nextRay.direction, material);
+                if (pdf <= 0) break;
+                throughput *= BRDF_Evaluate(V, N, nextRay.direction, material, res.hitColor) * dot(N, nextRay.direction) / pdf;
+                brdfPdf = (1.0f - transmit) * pdf;
+            }
+
+            lastNormal = N;
+            ray = nextRay;
+            res = shoot(accel, ray);
         }
 
         return color;
     }
 
     void render(EasyScene& scene, Camera& camera, int width, int height, int samples, const std::string &filename, bool legacy = true) {
-        vector<Shape *>shapes = scene.shapes;
-        vector<Triangle *>lights = scene.lights;
+        SceneBVH accel(scene.shapes);
+        LightSampler lights(scene.lights, lightSampling);
         double *image = new double[width * height * 3];
         memset(image, 0.0, sizeof(double) * width * height * 3);
 
-        omp_set_num_threads(50);
-#pragma omp parallel for
-        for (int k = 0; k < samples; k++) {
-            for (int sx = 0; sx < 2; ++sx) {
-                for (int sy = 0; sy < 2; ++sy) {
-                    double *p = image;
-
-                    for (int i = 0; i < height; i++) {
-                        fprintf(stderr, "\rRendering (%d spp)", samples * 4);
-                        for (int j = 0; j < width; j++) {
-
-                            double x = 2.0 * double(j) / double(width) - 1.0;
-                            double y = 2.0 * double(i) / double(height) - 1.0;
-
-                            //from smallpt
-                            //tent filter
-                            double r1 = 2.0 * randf();
-                            r1 = r1 < 1 ? sqrt(r1) - 1 : 1 - sqrt(2 - r1);
-                            double r2 = 2.0 * randf();
-                            r2 = r2 < 1 ? sqrt(r2) - 1 : 1 - sqrt(2 - r2);
-
-                            //抗锯齿
-                            x += (sx + 0.5 + r1) / double(width);
-                            y -= (sy + 0.5 + r2) / double(height);;
-
-                            Ray ray;
-                            camera.castRay(vec2(x, y), ray);
-
-                            // 与场景的交点
-                            HitResult res = shoot(shapes, ray);
-                            vec3 color = vec3(0, 0, 0);
-
-                            if (res.isHit) {
-                                if (res.material.isEmissive) {
-                                    color = res.hitColor;
-                                }
-                                else {
-                                    Ray nextRay;
-                                    nextRay.startPoint = res.hitPoint;
-                                    nextRay.direction = randomDirection(res.material.normal);
-                                    nextRay.time = ray.time;
-
-                                    double r = randf();
-                                    if (r < res.material.specularRate) {
-                                        vec3 ref = normalize(reflect(ray.direction, res.material.normal));
-                                        nextRay.direction = mix(ref, nextRay.direction, res.material.roughness);
-                                        color = pathTracingNEE(shapes, nextRay, 0, lights, res.material, res.hitColor, legacy, ray.direction);
-                                    }
-                                    else if (res.material.specularRate <= r && r <= res.material.refractRate) {
-                                        vec3 ref = normalize(
-                                                refract(ray.direction, res.material.normal,
-                                                        float(res.material.refractRate)));
-                                        nextRay.direction = mix(ref, -nextRay.direction, res.material.refractRoughness);
-                                        color = pathTracingNEE(shapes, nextRay, 0, lights, res.material, res.hitColor, legacy, ray.direction);
-                                    }
-                                    else {
-                                        vec3 srcColor = res.hitColor;
-                                        vec3 ptColor = pathTracingNEE(shapes, nextRay, 0, lights, res.material, res.hitColor, legacy, ray.direction);
-                                        color = ptColor * srcColor;
+        // 把画面切成 tileSize x tileSize 的块，线程从队列里动态领取；
+        // 每个块先在自己的缓冲区里累积，完成后加回 image 中互不重叠的区域，不需要原子操作
+        int tilesX = (width + tileSize - 1) / tileSize;
+        int tilesY = (height + tileSize - 1) / tileSize;
+        int tileCount = tilesX * tilesY;
+        int numThreads = threads > 0 ? threads : omp_get_num_procs();
+        int pixelSamples = samples * 4;
+        double startTime = omp_get_wtime();
+
+        // 每个像素样本亮度的和与平方和，用来估计误差；样本颜色已经乘过 1 / pixelSamples
+        vector<double> sum(width * height, 0.0), sumSq(width * height, 0.0);
+        sampleCounts.assign(width * height, 0);
+        vector<int> active(tileCount);
+        for (int tile = 0; tile < tileCount; tile++) active[tile] = tile;
+
+        // 第一遍采样所有块；开启 adaptive 时之后每一遍只采样上一遍结束后误差还超过阈值的块
+        for (int pass = 0; !active.empty(); pass++) {
+            int activeCount = (int) active.size();
+            int tilesDone = 0;
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(numThreads)
+            for (int t = 0; t < activeCount; t++) {
+                int tile = active[t];
+                int x0 = (tile % tilesX) * tileSize;
+                int y0 = (tile / tilesX) * tileSize;
+                int x1 = std::min(x0 + tileSize, width);
+                int y1 = std::min(y0 + tileSize, height);
+                int tileWidth = x1 - x0;
+                vector<double> buffer(tileWidth * (y1 - y0) * 3, 0.0);
+
+                for (int i = y0; i < y1; i++) {
+                    for (int j = x0; j < x1; j++) {
+                        double *p = &buffer[((i - y0) * tileWidth + (j - x0)) * 3];
+                        for (int k = 0; k < samples; k++) {
+                            for (int sx = 0; sx < 2; ++sx) {
+                                for (int sy = 0; sy < 2; ++sy) {
+                                    uint64_t pixel = uint64_t(pass) * width * height + uint64_t(i) * width + j;
+                                    uint32_t index = pass * pixelSamples + (k * 2 + sx) * 2 + sy;
+                                    seedRandom(seed, pixel * pixelSamples + (k * 2 + sx) * 2 + sy);
+                                    startSample(samplerType, seed, uint64_t(i) * width + j, index);
+
+                                    double x = 2.0 * double(j) / double(width) - 1.0;
+                                    double y = 2.0 * double(i) / double(height) - 1.0;
+
+                                    //from smallpt
+                                    //tent filter
+                                    double r1, r2;
+                                    sample2D(r1, r2);
+                                    r1 *= 2.0;
+                                    r1 = r1 < 1 ? sqrt(r1) - 1 : 1 - sqrt(2 - r1);
+                                    r2 *= 2.0;
+                                    r2 = r2 < 1 ? sqrt(r2) - 1 : 1 - sqrt(2 - r2);
+
+                                    //抗锯齿
+                                    x += (sx + 0.5 + r1) / double(width);
+                                    y -= (sy + 0.5 + r2) / double(height);;
+
+                                    Ray ray;
+                                    camera.castRay(vec2(x, y), ray);
+
+                                    // 与场景的交点
+                                    HitResult res = shoot(accel, ray);
+                                    vec3 color = vec3(0, 0, 0);
+
+                                    if (!legacy) {
+                                        color = pathTracingMIS(accel, ray, res, lights) * float(0.25 / samples);
+                                    } else if (res.isHit) {
+                                        if (res.material->isEmissive) {
+                                            color = res.hitColor;
+                                        }
+                                        else {
+                                            Ray nextRay;
+                                            nextRay.startPoint = res.hitPoint;
+                                            nextRay.direction = randomDirection(res.normal);
+                                            nextRay.time = ray.time;
+
+                                            double r = randf();
+                                            if (r < res.material->specularRate) {
+                                                vec3 ref = normalize(reflect(ray.direction, res.normal));
+                                                nextRay.direction = mix(ref, nextRay.direction, res.material->roughness);
+                                                color = pathTracingNEE(accel, nextRay, 0, lights, *res.material, res.normal, res.hitColor);
+                                            }
+                                            else if (res.material->specularRate <= r && r <= res.material->refractRate) {
+                                                vec3 ref = normalize(
+                                                        refract(ray.direction, res.normal,
+                                                                float(res.material->refractRate)));
+                                                nextRay.direction = mix(ref, -nextRay.direction, res.material->refractRoughness);
+                                                color = pathTracingNEE(accel, nextRay, 0, lights, *res.material, res.normal, res.hitColor);
+                                            }
+                                            else {
+                                                vec3 srcColor = res.hitColor;
+                                                vec3 ptColor = pathTracingNEE(accel, nextRay, 0, lights, *res.material, res.normal, res.hitColor);
+                                                color = ptColor * srcColor;
+                                            }
+
+                                            //1/pdf is always 2*PI thanks to our living in a 3D world
+                                            color *= (2.0f * 3.1415926f) * (1.0f / double(samples)) * 0.25;
+                                        }
                                     }
 
-                                    //1/pdf is always 2*PI thanks to our living in a 3D world
-                                    color *= (2.0f * 3.1415926f) * (1.0f / double(samples)) * 0.25;
+                                    p[0] += color.x;
+                                    p[1] += color.y;
+                                    p[2] += color.z;
+                                    double l = (color.x + color.y + color.z) / 3.0;
+                                    sum[i * width + j] += l;
+                                    sumSq[i * width + j] += l * l;
                                 }
                             }
-
-                            *p += color.x;
-                            p++;
-                            *p += color.y;
-                            p++;
-                            *p += color.z;
-                            p++;
                         }
                     }
                 }
+
+                for (int i = y0; i < y1; i++) {
+                    for (int c = 0; c < tileWidth * 3; c++) {
+                        image[(i * width + x0) * 3 + c] += buffer[(i - y0) * tileWidth * 3 + c];
+                    }
+                    for (int j = x0; j < x1; j++) {
+                        sampleCounts[i * width + j] += pixelSamples;
+                    }
+                }
+
+#pragma omp critical
+                {
+                    tilesDone++;
+                    fprintf(stderr, "\rRendering pass %d (%d spp, %d/%d tiles) %5.1f%%", pass + 1, pixelSamples,
+                            activeCount, tileCount, 100.0 * tilesDone / activeCount);
+                }
+            }
+
+            if (!adaptive || pass + 1 >= adaptiveMaxPasses) break;
+            if (timeBudget > 0 && omp_get_wtime() - startTime > timeBudget) break;
+
+            // 像素值是样本的平均，它的标准误差为 sqrt(方差 / n)；除以亮度得到相对误差，
+            // 加上 0.01 避免很暗的像素因为相对误差大而一直采样。块的误差取像素的平均，
+            // 取最大值的话几乎每个块里都有个别噪点像素，所有块都会一直采样下去
+            vector<int> next;
+            for (int tile : active) {
+                int x0 = (tile % tilesX) * tileSize;
+                int y0 = (tile / tilesX) * tileSize;
+                int x1 = std::min(x0 + tileSize, width);
+                int y1 = std::min(y0 + tileSize, height);
+                double error = 0;
+                for (int i = y0; i < y1; i++) {
+                    for (int j = x0; j < x1; j++) {
+                        int n = sampleCounts[i * width + j];
+                        double mean = sum[i * width + j] / n;
+                        double variance = std::max(0.0, sumSq[i * width + j] / n - mean * mean) * n / (n - 1);
+                        double stdError = pixelSamples * sqrt(variance / n);
+                        error += stdError / (pixelSamples * mean + 0.01);
+                    }
+                }
+                error /= (x1 - x0) * (y1 - y0);
+                if (error > adaptiveThreshold) next.push_back(tile);
             }
+            active = next;
+        }
+
+        // 追加过样本的像素按实际样本数重新归一化
+        for (int i = 0; i < width * height; i++) {
+            if (sampleCounts[i] == pixelSamples) continue;
+            for (int c = 0; c < 3; c++) image[i * 3 + c] *= double(pixelSamples) / sampleCounts[i];
         }
         if(filename.find(".png") != string::npos)
             savepng(image, width, height, filename.c_str());
         else
             saveppm(image, width, height, filename.c_str());
         printf("\nSaved image to %s\n", filename.c_str());
+
+        // 每个像素实际的样本数原样保存在 xxx_spp.pgm，不做 gamma 和归一化
+        if (adaptive) {
+            int maxCount = *std::max_element(sampleCounts.begin(), sampleCounts.end());
+            long long total = 0;
+            for (int i = 0; i < width * height; i++) total += sampleCounts[i];
+            size_t dot = filename.find_last_of('.');
+            std::string countsFile = (dot == string::npos ? filename : filename.substr(0, dot)) + "_spp.pgm";
+            savepgm(sampleCounts.data(), width, height, countsFile.c_str());
+            printf("Average %.1f spp (max %d), sample counts saved to %s\n", double(total) / (width * height), maxCount,
+                   countsFile.c_str());
+        }
     }
 };
\ No newline at end of file
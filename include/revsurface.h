@@ -8,6 +8,9 @@
 
 const int NEWTON_STEPS = 20;
 const float NEWTON_EPS = 1e-2;
+// 牛顿迭代的初始曲线参数 mu，依次尝试，取最近的交点
+const int NEWTON_SEEDS = 4;
+const float NEWTON_MU_SEEDS[NEWTON_SEEDS] = {0.125f, 0.375f, 0.625f, 0.875f};
 class RevSurface : public Shape {
     BezierCurve *pCurve;
     vec3 aa;
@@ -29,12 +32,73 @@ class RevSurface : public Shape {
         bb = vec3(pCurve->radius, pCurve->ymax + 3, pCurve->radius);
     }
 
-    HitResult intersect(const Ray r) override {
-        float t, rou, mu;
-        HitResult rst;
+    // rec.u / rec.v 记录交点处的曲面参数 rou / mu，resolve 时据此重新计算法向量
+    bool intersect(const Ray& r, HitRecord& rec) override {
+        float t = 0, rou = 0, mu = 0;
+        if (!solve(r, t, rou, mu)) return false;
+        if (t >= rec.distance) return false;
+
+        rec.distance = t;
+        rec.shape = this;
+        rec.primID = -1;
+        rec.u = rou;
+        rec.v = mu;
+        rec.time = r.time;
+        return true;
+    }
+
+    void resolve(const Ray& r, const HitRecord& rec, HitResult& rst) override {
+        vec3 drou, dmu;
+        getPoint(rec.u, rec.v, drou, dmu);
+        vec3 normal = cross(dmu, drou);
+
+        if (dot(normal, r.direction) > 0.0f) {
+            normal = -normal;
+        }
+
+        rst.isHit = true;
+        rst.distance = rec.distance;
+        rst.hitPoint = r.startPoint + r.direction * rec.distance;
+        rst.material = &material;
+        rst.time = rec.time;
+        rst.normal = normalize(normal);
+        rst.hitColor = material.color;
+    }
+
+    bool getBounds(vec3& AA, vec3& BB) override {
+        AA = aa;
+        BB = bb;
+        return true;
+    }
+
+    bool occluded(Ray r, float tMax) override {
+        float t = 0, rou = 0, mu = 0;
+        return solve(r, t, rou, mu) && t < tMax;
+    }
+
+    // 求光线与旋转面最近的交点，返回是否相交以及距离和交点处的曲面参数。
+    // t 从光线进入包围盒处开始，mu 依次取 NEWTON_MU_SEEDS，rou 取进入点绕 y 轴的角度
+    bool solve(const Ray& r, float& t, float& rou, float& mu) {
         //AABB进行加速
-        if (hitAABB(r, aa, bb) == -1) return rst;
+        vec3 invdir = vec3(1.0 / r.direction.x, 1.0 / r.direction.y, 1.0 / r.direction.z);
+        float tEnter = hitAABB(r.startPoint, invdir, aa, bb, INF);
+        if (tEnter < 0) return false;
+        vec3 enter = r.startPoint + r.direction * tEnter;
+
+        bool hit = false;
+        for (int k = 0; k < NEWTON_SEEDS; k++) {
+            float tk = tEnter, muk = NEWTON_MU_SEEDS[k];
+            // 轮廓上 x 为负的点转过 rou 后落在 rou + PI 的方向
+            float rouk = atan2(-enter.z, enter.x) + (pCurve->getPoint(muk).V.x < 0 ? PI : 0.0f);
+            if (!newton(r, tk, rouk, muk)) continue;
+            if (!hit || tk < t) t = tk, rou = rouk, mu = muk;
+            hit = true;
+        }
+        return hit;
+    }
 
+    // 从给定的 t、rou、mu 出发做牛顿迭代，收敛到光线前方的曲面上时返回 true
+    bool newton(const Ray& r, float& t, float& rou, float& mu) {
         vec3 normal, point;
 
         vec3 dmu, drou;
@@ -64,25 +128,13 @@ class RevSurface : public Shape {
         }
 
         // out of steps
-        if(i == NEWTON_STEPS || !isnormal(mu) || !isnormal(rou) || !isnormal(t)) return rst;
-
-        if (t < 0 || mu < 0 || mu > 1)
-            return rst;
-
-        if (dot(normal, r.direction) > 0.0f) {
-            normal = -normal;
-        }
+        if(i == NEWTON_STEPS || !isnormal(mu) || !isnormal(rou) || !isnormal(t)) return false;
 
-        rst.isHit = true;
-        rst.distance = t;
-        rst.hitPoint = r.startPoint + r.direction * t;
-        rst.material = material;
-        rst.time = r.time;
-        rst.hitColor = material.color;
-        rst.material.normal = normalize(normal);
-        rst.hitColor = material.color;
+        // 与其他形状一致，丢弃距起点过近的交点，避免次级光线与自身相交
+        if (t < 0.0005f || mu < 0 || mu > 1)
+            return false;
 
-        return rst;
+        return true;
     }
 
     vec3 getPoint(const float &rou, const float &mu, vec3 &drou, vec3 &dmu) {
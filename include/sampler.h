@@ -0,0 +1,213 @@
+#pragma once
+#include <cstdint>
+#include <algorithm>
+
+// PCG32 (https://www.pcg-random.org)，状态只有 16 字节，每个线程一份
+struct PCG32 {
+    uint64_t state = 0x853c49e6748fea9bULL;
+    uint64_t inc = 0xda3e39cb94b95bdbULL;
+
+    // seq 选择相互独立的序列，initstate 选择序列中的起点
+    void seed(uint64_t initstate, uint64_t seq) {
+        state = 0;
+        inc = (seq << 1u) | 1u;
+        next();
+        state += initstate;
+        next();
+    }
+
+    uint32_t next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = uint32_t(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+};
+
+// 采样器类型
+enum SamplerType {
+    SAMPLER_RANDOM,     // 每一维都是独立的伪随机数
+    SAMPLER_SOBOL,      // Owen 扰乱的 Sobol 序列，每两维一组
+    SAMPLER_HALTON      // Owen 扰乱的 Halton 序列，每一维一个素数底
+};
+
+// 低差异序列只用于前这么多维，大约是前三个顶点；再往后的维度对误差的影响很小，退回伪随机数
+const int SAMPLER_DIMENSIONS = 32;
+
+// Halton 序列每一维的素数底
+const uint32_t HALTON_PRIMES[SAMPLER_DIMENSIONS] = {
+    2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+    59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131
+};
+
+// 64 位整数的混合函数（splitmix64 的后半段），用来从像素、维度得到扰乱用的种子
+inline uint64_t mixBits(uint64_t v) {
+    v ^= v >> 31;
+    v *= 0x7fb5d329728ea185ULL;
+    v ^= v >> 27;
+    v *= 0x81dadef4bc2dd44dULL;
+    v ^= v >> 33;
+    return v;
+}
+
+inline uint32_t reverseBits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+// 以 2 为底的 Owen 扰乱（Burley 2020, Practical Hash-based Owen Scrambling）：
+// Laine-Karras 置换只让高位影响低位，把 x 的位反过来做一次，就变成每一位只被更高的位决定，
+// 等价于在二叉树的每个节点上按种子随机翻转，扰乱后仍保持原序列的分层性质
+inline uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverseBits(x);
+}
+
+// Sobol 序列的前两维：第一维是以 2 为底的根反演，第二维的生成矩阵是模 2 的 Pascal 矩阵；
+// 二者组成 (0, 2) 序列，任意 2 的幂个连续样本在二维上都是分层的
+inline uint32_t sobol0(uint32_t index) {
+    return reverseBits(index);
+}
+
+// 第二维按字节查表：4 张表分别对应 index 的 4 个字节，表项是该字节选中的生成矩阵各列的异或
+struct Sobol1Table {
+    uint32_t table[4][256];
+
+    Sobol1Table() {
+        uint32_t columns[32];
+        uint32_t v = 1u << 31;
+        for (int bit = 0; bit < 32; bit++, v ^= v >> 1) columns[bit] = v;
+        for (int byte = 0; byte < 4; byte++) {
+            for (int i = 0; i < 256; i++) {
+                uint32_t x = 0;
+                for (int k = 0; k < 8; k++) {
+                    if (i & (1 << k)) x ^= columns[byte * 8 + k];
+                }
+                table[byte][i] = x;
+            }
+        }
+    }
+};
+
+inline uint32_t sobol1(uint32_t index) {
+    static const Sobol1Table sobol;
+    return sobol.table[0][index & 0xff] ^ sobol.table[1][(index >> 8) & 0xff] ^
+           sobol.table[2][(index >> 16) & 0xff] ^ sobol.table[3][index >> 24];
+}
+
+// [0, n) 上由种子 seed 决定的一个随机排列中第 i 个元素（Kensler 2013, Correlated Multi-Jittered Sampling）：
+// 在不小于 n 的 2 的幂上做一串可逆的混合，落在 n 之外就继续混合直到落回来
+inline uint32_t permutationElement(uint32_t i, uint32_t n, uint32_t seed) {
+    uint32_t w = n - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= seed;
+        i *= 0xe170893du;
+        i ^= seed >> 16;
+        i ^= (i & w) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3fu;
+        i ^= seed >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69u;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303u;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3u;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3dfu;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= n);
+    return (i + seed) % n;
+}
+
+// 以 base 为底的 Owen 扰乱根反演：每一位数字按已经生成的高位（树上的节点）做一次随机排列，
+// hash 不同的两个序列互不相关。逐位计算到足以区分每个像素 4096 个样本的位数（index 更大时算到它的最高位），
+// 再往后的各位只取决于已经生成的前缀，合起来就是当前区间里的一个均匀随机数，直接由前缀的哈希给出
+inline double owenScrambledRadicalInverse(uint32_t base, uint32_t index, uint64_t hash) {
+    // 以 2 为底时就是二进制的 Owen 扰乱，用位运算一次完成
+    if (base == 2) return nestedUniformScramble(reverseBits(index), uint32_t(hash)) * (1.0 / 4294967296.0);
+    const double invBase = 1.0 / base;
+    double invBaseM = 1.0;
+    uint64_t reversed = 0;
+    for (int level = 0; index > 0 || invBaseM > 1.0 / 4096.0; level++) {
+        uint32_t next = index / base;
+        uint32_t digit = index - next * base;
+        uint32_t seed = uint32_t(mixBits(hash ^ (reversed << 6) ^ uint64_t(level)));
+        reversed = reversed * base + permutationElement(digit, base, seed);
+        invBaseM *= invBase;
+        index = next;
+    }
+    double tail = (mixBits(hash ^ (reversed << 6) ^ 63) >> 32) * (1.0 / 4294967296.0);
+    return std::min((reversed + tail) * invBaseM, 1.0 - 1e-12);
+}
+
+// 采样器：一个像素的一个样本从 start 开始，之后每次 get1D / get2D 取下一维（2D 占两维）。
+// 同一个像素的各个样本在每一维上构成一个低差异序列，不同像素、不同维度使用不同的扰乱种子而互不相关；
+// SAMPLER_RANDOM 时直接返回伪随机数，取数的顺序和原来逐个调用 randf() 完全一样
+class Sampler {
+public:
+    SamplerType type = SAMPLER_RANDOM;
+    PCG32 rng;
+
+    // pixel 为像素编号，index 为该像素内的样本序号，伪随机数的种子仍由 rng.seed 单独设定
+    void start(SamplerType samplerType, uint64_t seed, uint64_t pixel, uint32_t index) {
+        type = samplerType;
+        pixelHash = mixBits(mixBits(seed) ^ pixel);
+        sampleIndex = index;
+        dimension = 0;
+    }
+
+    double random() {
+        return rng.next() * (1.0 / 4294967296.0);
+    }
+
+    double get1D() {
+        if (dimension >= SAMPLER_DIMENSIONS) return random();
+        if (type == SAMPLER_SOBOL) {
+            uint64_t hash = mixBits(pixelHash ^ dimension++);
+            uint32_t index = nestedUniformScramble(sampleIndex, uint32_t(hash));
+            return nestedUniformScramble(sobol0(index), uint32_t(hash >> 32)) * (1.0 / 4294967296.0);
+        }
+        if (type == SAMPLER_HALTON) {
+            uint64_t hash = mixBits(pixelHash ^ dimension);
+            return owenScrambledRadicalInverse(HALTON_PRIMES[dimension++], sampleIndex, hash);
+        }
+        return random();
+    }
+
+    // Sobol 的两维来自同一个 (0, 2) 序列；Halton 连续取两个素数底
+    void get2D(double& u, double& v) {
+        if (type == SAMPLER_SOBOL && dimension + 1 < SAMPLER_DIMENSIONS) {
+            uint64_t hash = mixBits(pixelHash ^ dimension);
+            dimension += 2;
+            uint32_t index = nestedUniformScramble(sampleIndex, uint32_t(hash));
+            u = nestedUniformScramble(sobol0(index), uint32_t(hash >> 32)) * (1.0 / 4294967296.0);
+            v = nestedUniformScramble(sobol1(index), uint32_t(mixBits(hash))) * (1.0 / 4294967296.0);
+            return;
+        }
+        u = get1D();
+        v = get1D();
+    }
+
+private:
+    uint64_t pixelHash = 0;
+    uint32_t sampleIndex = 0;
+    uint32_t dimension = 0;
+};
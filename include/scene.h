@@ -158,6 +158,44 @@ public:
         shapes.push_back(new Triangle(vec3(1, -1, -1), vec3(1, 1, 1), vec3(1, 1, -1), Material(RED)));
     }
 
+    // 同一个模型摆放 gridSize x gridSize 份：Mesh 只加载一次、BVH 只构建一次，每个位置是一个只带变换的 Instance
+    void loadInstancedScene(const char* filename, int gridSize = 4, bool smooth = false){
+        Mesh* mesh = new Mesh(filename, WHITE, vec3(0, 0, 0), vec3(0, 0, 0), vec3(1.0, 1.0, 1.0), false, smooth);
+        float cell = 1.8f / gridSize;
+        for (int i = 0; i < gridSize; i++) {
+            for (int j = 0; j < gridSize; j++) {
+                vec3 position = vec3(-0.9f + cell * (i + 0.5f), -1.0f + cell * 0.4f, -0.9f + cell * (j + 0.5f));
+                shapes.push_back(new Instance(mesh, vec3(0, 37.0f * (i * gridSize + j), 0), position, vec3(cell * 0.8f)));
+            }
+        }
+        // 发光物
+        Triangle* l1 = new Triangle(vec3(0.4, 0.99, 0.4), vec3(-0.4, 0.99, -0.4), vec3(-0.4, 0.99, 0.4), Material(WHITE));
+        Triangle* l2 = new Triangle(vec3(0.4, 0.99, 0.4), vec3(0.4, 0.99, -0.4), vec3(-0.4, 0.99, -0.4), Material(WHITE));
+        l1->material.isEmissive = true;
+        l2->material.isEmissive = true;
+        lights.push_back(l1);
+        lights.push_back(l2);
+        shapes.push_back(l1);
+        shapes.push_back(l2);
+
+        // 背景盒子
+        // bottom
+        shapes.push_back(new Triangle(vec3(1, -1, 1), vec3(-1, -1, -1), vec3(-1, -1, 1), Material(WHITE)));
+        shapes.push_back(new Triangle(vec3(1, -1, 1), vec3(1, -1, -1), vec3(-1, -1, -1), Material(WHITE)));
+        // top
+        shapes.push_back(new Triangle(vec3(1, 1, 1), vec3(-1, 1, 1), vec3(-1, 1, -1), Material(WHITE)));
+        shapes.push_back(new Triangle(vec3(1, 1, 1), vec3(-1, 1, -1), vec3(1, 1, -1), Material(WHITE)));
+        // back
+        shapes.push_back(new Triangle(vec3(1, -1, -1), vec3(-1, 1, -1), vec3(-1, -1, -1), Material(CYAN)));
+        shapes.push_back(new Triangle(vec3(1, -1, -1), vec3(1, 1, -1), vec3(-1, 1, -1), Material(CYAN)));
+        // left
+        shapes.push_back(new Triangle(vec3(-1, -1, -1), vec3(-1, 1, 1), vec3(-1, -1, 1), Material(BLUE)));
+        shapes.push_back(new Triangle(vec3(-1, -1, -1), vec3(-1, 1, -1), vec3(-1, 1, 1), Material(BLUE)));
+        // right
+        shapes.push_back(new Triangle(vec3(1, 1, 1), vec3(1, -1, -1), vec3(1, -1, 1), Material(RED)));
+        shapes.push_back(new Triangle(vec3(1, -1, -1), vec3(1, 1, 1), vec3(1, 1, -1), Material(RED)));
+    }
+
     void loadFinalScene(const char* filename, const char* textureFile="", const char* normFile="", bool bruteForce = false, bool smooth = false){
         Mesh* m = new Mesh(filename, WHITE, vec3(0, 0, 0), vec3(0.3, -1.2, 0.0), vec3(1.0, 1.0, 1.0), bruteForce, smooth, textureFile);
         shapes.push_back(m);
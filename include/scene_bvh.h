@@ -0,0 +1,226 @@
+#pragma once
+#include <typeinfo>
+#include "bvh.h"
+#include "mesh.h"
+#include "revsurface.h"
+
+// 场景中物体的具体类型，决定叶子里走哪一段求交代码
+enum ShapeKind {
+    SHAPE_TRIANGLE,
+    SHAPE_SPHERE,
+    SHAPE_MESH,         // Mesh 作为一个整体叶子，进入后再走它自己的 BVH
+    SHAPE_INSTANCE,
+    SHAPE_REVSURFACE,
+    SHAPE_OTHER         // 无法归类的物体，仍然调用虚函数
+};
+
+// 叶子中一段同类型的物体：对应类型数组中从 first 开始的 count 个
+struct ShapeRun {
+    ShapeKind kind;
+    int first;
+    int count;
+};
+
+// 场景顶层 BVH：建立在所有物体的包围盒上，构建后把物体按具体类型拆到各自的数组里，
+// 每个叶子里的物体按类型排好，同类型的在数组中连续存放，叶子记录的是若干段 ShapeRun。
+// 求交时每段是一个直接调用具体类型函数的循环，不经过虚函数表；单独的三角形拷贝进 SoA 做 SIMD 求交。
+// Shape 的虚函数接口仍然用来搭建场景，这里只在最后还原表面信息时调用一次 resolve。
+// 没有包围盒的物体单独放在 unbounded 里逐个求交
+class SceneBVH {
+public:
+    std::vector<Triangle*> triangles;   // 与 triangleSoA 的顺序一致
+    TriangleSoA triangleSoA;
+    std::vector<Sphere*> spheres;
+    std::vector<Mesh*> meshes;
+    std::vector<Instance*> instances;
+    std::vector<RevSurface*> revSurfaces;
+    std::vector<Shape*> others;
+    std::vector<Shape*> unbounded;
+
+    std::vector<ShapeRun> runs;         // 叶子的 offset / n 指向这里
+    std::vector<LinearBVHNode> nodes;
+    std::vector<WideBVHNode> wide;      // 由 nodes 合并得到，遍历时使用
+
+    SceneBVH() {}
+
+    explicit SceneBVH(const std::vector<Shape*>& list, int n = 4) {
+        std::vector<BVHPrimitive> prims;
+        std::vector<Shape*> bounded;
+        std::vector<ShapeKind> kinds;
+        for (auto &shape: list) {
+            BVHPrimitive p;
+            if (!shape->getBounds(p.AA, p.BB)) {
+                unbounded.push_back(shape);
+                continue;
+            }
+            p.center = 0.5f * (p.AA + p.BB);
+            p.index = (int) bounded.size();
+            bounded.push_back(shape);
+            kinds.push_back(kindOf(shape));
+            prims.push_back(p);
+        }
+        if (prims.empty()) return;
+
+        BVHNode* root = buildBVHSAH(prims, 0, (int) prims.size() - 1, n);
+        if (flattenBVH(root, nodes) < 0) {
+            // 构建时限制了深度，正常不会走到这里
+            deleteBVH(root);
+            nodes.clear();
+            root = buildBVH(prims, 0, (int) prims.size() - 1, n);
+            flattenBVH(root, nodes);
+        }
+        deleteBVH(root);
+
+        for (auto& node: nodes) {
+            if (node.n == 0) continue;
+            auto begin = prims.begin() + node.offset, end = begin + node.n;
+            std::stable_sort(begin, end, [&](const BVHPrimitive& a, const BVHPrimitive& b) {
+                return kinds[a.index] < kinds[b.index];
+            });
+            int first = (int) runs.size();
+            for (auto it = begin; it != end; ++it) {
+                ShapeKind kind = kinds[it->index];
+                int index = append(kind, bounded[it->index]);
+                if ((int) runs.size() == first || runs.back().kind != kind)
+                    runs.push_back({kind, index, 0});
+                runs.back().count++;
+            }
+            node.offset = first;
+            node.n = (int) runs.size() - first;
+        }
+        wide = buildWideBVH(nodes);
+
+        std::vector<vec3> vertices;
+        std::vector<uint32_t> indices;
+        for (auto tri: triangles) {
+            vertices.push_back(tri->p1);
+            vertices.push_back(tri->p2);
+            vertices.push_back(tri->p3);
+        }
+        for (uint32_t i = 0; i < (uint32_t) vertices.size(); i++) {
+            indices.push_back(i);
+        }
+        triangleSoA.build(vertices, indices);
+    }
+
+    // 按实际类型精确匹配：子类可能重写了求交，只能当作 SHAPE_OTHER
+    static ShapeKind kindOf(Shape* shape) {
+        const std::type_info& type = typeid(*shape);
+        if (type == typeid(Triangle)) return SHAPE_TRIANGLE;
+        if (type == typeid(Sphere)) return SHAPE_SPHERE;
+        if (type == typeid(Mesh)) return SHAPE_MESH;
+        if (type == typeid(Instance)) return SHAPE_INSTANCE;
+        if (type == typeid(RevSurface)) return SHAPE_REVSURFACE;
+        return SHAPE_OTHER;
+    }
+
+    // 追加到对应类型的数组末尾，返回在该数组中的下标
+    int append(ShapeKind kind, Shape* shape) {
+        switch (kind) {
+            case SHAPE_TRIANGLE:
+                triangles.push_back(static_cast<Triangle*>(shape));
+                return (int) triangles.size() - 1;
+            case SHAPE_SPHERE:
+                spheres.push_back(static_cast<Sphere*>(shape));
+                return (int) spheres.size() - 1;
+            case SHAPE_MESH:
+                meshes.push_back(static_cast<Mesh*>(shape));
+                return (int) meshes.size() - 1;
+            case SHAPE_INSTANCE:
+                instances.push_back(static_cast<Instance*>(shape));
+                return (int) instances.size() - 1;
+            case SHAPE_REVSURFACE:
+                revSurfaces.push_back(static_cast<RevSurface*>(shape));
+                return (int) revSurfaces.size() - 1;
+            default:
+                others.push_back(shape);
+                return (int) others.size() - 1;
+        }
+    }
+
+    // 一段同类型物体的最近交点，用限定名调用，编译期就确定了调用目标
+    bool intersectRun(const ShapeRun& run, const Ray& ray, HitRecord& rec) {
+        bool hit = false;
+        int end = run.first + run.count;
+        switch (run.kind) {
+            case SHAPE_TRIANGLE:
+                if (hitTriangleSoA(ray, triangleSoA, run.first, run.count, rec)) {
+                    rec.shape = triangles[rec.primID];
+                    hit = true;
+                }
+                break;
+            case SHAPE_SPHERE:
+                for (int i = run.first; i < end; i++) hit |= spheres[i]->Sphere::intersect(ray, rec);
+                break;
+            case SHAPE_MESH:
+                for (int i = run.first; i < end; i++) hit |= meshes[i]->Mesh::intersect(ray, rec);
+                break;
+            case SHAPE_INSTANCE:
+                for (int i = run.first; i < end; i++) hit |= instances[i]->Instance::intersect(ray, rec);
+                break;
+            case SHAPE_REVSURFACE:
+                for (int i = run.first; i < end; i++) hit |= revSurfaces[i]->RevSurface::intersect(ray, rec);
+                break;
+            default:
+                for (int i = run.first; i < end; i++) hit |= others[i]->intersect(ray, rec);
+                break;
+        }
+        return hit;
+    }
+
+    bool occludedRun(const ShapeRun& run, const Ray& ray, float tMax) {
+        int end = run.first + run.count;
+        switch (run.kind) {
+            case SHAPE_TRIANGLE:
+                return occludedTriangleSoA(ray, triangleSoA, run.first, run.count, tMax);
+            case SHAPE_SPHERE:
+                for (int i = run.first; i < end; i++) if (spheres[i]->Sphere::occluded(ray, tMax)) return true;
+                return false;
+            case SHAPE_MESH:
+                for (int i = run.first; i < end; i++) if (meshes[i]->Mesh::occluded(ray, tMax)) return true;
+                return false;
+            case SHAPE_INSTANCE:
+                for (int i = run.first; i < end; i++) if (instances[i]->Instance::occluded(ray, tMax)) return true;
+                return false;
+            case SHAPE_REVSURFACE:
+                for (int i = run.first; i < end; i++) if (revSurfaces[i]->RevSurface::occluded(ray, tMax)) return true;
+                return false;
+            default:
+                for (int i = run.first; i < end; i++) if (others[i]->occluded(ray, tMax)) return true;
+                return false;
+        }
+    }
+
+    // 先只用 HitRecord 找到最近交点，最后只对它还原一次表面信息
+    HitResult intersect(Ray ray) {
+        HitRecord rec;
+        for (auto &shape: unbounded) {
+            shape->intersect(ray, rec);
+        }
+        float closest = rec.distance;
+        traverseBVH(ray, wide, closest, [&](int offset, int n, float& clip) {
+            for (int i = offset; i < offset + n; i++) {
+                if (intersectRun(runs[i], ray, rec)) clip = rec.distance;
+            }
+        });
+
+        HitResult res;
+        if (rec.shape) {
+            rec.shape->resolve(ray, rec, res);
+            res.shape = rec.shape;
+        }
+        return res;
+    }
+
+    bool occluded(Ray ray, float tMax) {
+        for (auto &shape: unbounded) {
+            if (shape->occluded(ray, tMax)) return true;
+        }
+        return traverseBVHAny(ray, wide, tMax, [&](int offset, int n) {
+            for (int i = offset; i < offset + n; i++) {
+                if (occludedRun(runs[i], ray, tMax)) return true;
+            }
+            return false;
+        });
+    }
+};
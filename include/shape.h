@@ -28,7 +28,18 @@ public:
                 break;
         }
     }
-    virtual HitResult intersect(Ray ray) { return HitResult(); }
+    // 求交：只接受比 rec.distance 更近的交点，找到时更新 rec 并返回 true
+    virtual bool intersect(const Ray& /*ray*/, HitRecord& /*rec*/) { return false; }
+    // 对最终的最近交点还原表面信息：命中点、法向量、纹理颜色和材质
+    virtual void resolve(const Ray& /*ray*/, const HitRecord& /*rec*/, HitResult& /*res*/) {}
+    // 阴影光线查询：在 tMax 之前是否有遮挡，找到任意一个遮挡即可返回
+    virtual bool occluded(Ray ray, float tMax) {
+        HitRecord rec;
+        rec.distance = tMax;
+        return intersect(ray, rec);
+    }
+    // 包围盒，用于场景顶层 BVH；返回 false 表示没有有限的包围盒
+    virtual bool getBounds(vec3& /*AA*/, vec3& /*BB*/) { return false; }
     Material material;
 };
 
@@ -52,6 +63,7 @@ public:
     :Shape(B), id1(id1), id2(id2), id3(id3)
     {
         p1 = P1, p2 = P2, p3 = P3;
+        e1 = p2 - p1, e2 = p3 - p1;
         center = (p1 + p2 + p3) / 3.0f;
         material = m;
         material.normal = normalize(cross(p2 - p1, p3 - p1));
@@ -60,65 +72,75 @@ public:
     }
 
     vec3 p1, p2, p3;
+    vec3 e1, e2;    // 预先算好的两条边 p2 - p1, p3 - p1
     vec3 n1, n2, n3;
     int id1, id2 ,id3;
     vec3 I;
     vec3 center;
     bool smoothNormal;
 
-    HitResult intersect(Ray ray) override {
-        HitResult res;
+    // Möller–Trumbore 求交，只做几何判断，材质和纹理留到 resolve；
+    // rec.u / rec.v 是 p2 / p3 的重心坐标，p1 的为 1 - u - v
+    bool intersect(const Ray& ray, HitRecord& rec) override {
+        vec3 pvec = cross(ray.direction, e2);
+        float det = dot(e1, pvec);
+        if (fabs(det) < EPS) return false; // 光线与三角形平行
+
+        float invDet = 1.0f / det;
+        vec3 tvec = ray.startPoint - p1;
+        float u = dot(tvec, pvec) * invDet;
+        if (u < 0.0f || u > 1.0f) return false;
+
+        vec3 qvec = cross(tvec, e1);
+        float v = dot(ray.direction, qvec) * invDet;
+        if (v < 0.0f || u + v > 1.0f) return false;
+
+        float t = dot(e2, qvec) * invDet;
+        if (t < 0.0005f || t >= rec.distance) return false;
+
+        rec.distance = t;
+        rec.shape = this;
+        rec.primID = -1;
+        rec.u = u;
+        rec.v = v;
+        rec.time = ray.time;
+        return true;
+    }
 
-        vec3 S = ray.startPoint;
-        vec3 d = ray.direction;
+    void resolve(const Ray& ray, const HitRecord& rec, HitResult& res) override {
         vec3 N = material.normal;
         bool isInside = false;
-        if (dot(N, d) > 0.0f) {
+        if (dot(N, ray.direction) > 0.0f) {
             N = -N;
             isInside = true;
         }
 
-        if (fabs(dot(N, d)) < 0.00001f) return res;
-
-        float t = (dot(N, p1) - dot(S, N)) / dot(d, N);
-        if (t < 0.0005f) return res;
-
-        vec3 P = S + d * t;
-
-        vec3 c1 = cross(p2 - p1, P - p1);
-        vec3 c2 = cross(p3 - p2, P - p2);
-        vec3 c3 = cross(p1 - p3, P - p3);
-        vec3 n = material.normal;
-        bool r1 = (dot(c1, N) > 0 && dot(c2, N) > 0 && dot(c3, N) > 0);
-        bool r2 = (dot(c1, N) < 0 && dot(c2, N) < 0 && dot(c3, N) < 0);
+        vec3 P = ray.startPoint + ray.direction * rec.distance;
 
         //重心坐标系插值法向量
-        float EPSILON = 0.0001f;
-        //计算重心坐标系的三个参数(u,v,w)
-        float u = (-(P.x - p2.x) * (p3.y - p2.y) + (P.y - p2.y) * (p3.x - p2.x)) /
-                  (-(p1.x - p2.x) * (p3.y - p2.y) + (p1.y - p2.y) * (p3.x - p2.x));
-        float v = (-(P.x - p3.x) * (p1.y - p3.y) + (P.y - p3.y) * (p1.x - p3.x)) /
-                  ((p2.x - p3.x) * (p1.y - p3.y) + (p2.y - p3.y) * (p1.x - p3.x));
-        float w = 1.0f - u - v;
-
-        if(r1 || r2) {
-            res.isHit = true;
-            res.distance = t;
-            res.hitPoint = P;
-            res.material = material;
-
-            if(material.normalMap.pic){
-                res.material.normal = normalize(material.normalMap.getColor(u, v) * 2.0f - vec3(1,1,1));
-                if(isInside)
-                    res.material.normal = -res.material.normal;
-            }else{
-                if(!smoothNormal)
-                    res.material.normal = N;
-                else {
-                    vec3 Nsmooth = u * n1 + v * n2 + w * n3;
-                    Nsmooth = normalize(Nsmooth);
-                    res.material.normal = N;
-                }
+        //重心坐标系的三个参数(u,v,w)分别对应 p1, p2, p3
+        float u = 1.0f - rec.u - rec.v;
+        float v = rec.u;
+        float w = rec.v;
+
+        res.isHit = true;
+        res.distance = rec.distance;
+        res.hitPoint = P;
+        res.material = &material;
+        res.time = rec.time;
+
+        if(material.normalMap.pic){
+            res.normal = normalize(material.normalMap.getColor(u, v) * 2.0f - vec3(1,1,1));
+            if(isInside)
+                res.normal = -res.normal;
+        }else{
+            if(!smoothNormal)
+                res.normal = N;
+            else {
+                // 与 Mesh::resolve 一致：插值顶点法向量，和几何法向量一样翻到光线来的一侧
+                vec3 Nsmooth = u * n1 + v * n2 + w * n3;
+                Nsmooth = normalize(Nsmooth);
+                res.normal = isInside ? -Nsmooth : Nsmooth;
             }
         }
 
@@ -126,14 +148,39 @@ public:
             res.hitColor = material.texture.getColor(u, v);
         else
             res.hitColor = material.color;
+    }
 
-        return res;
-    };
+    bool getBounds(vec3& AA, vec3& BB) override {
+        AA = min(p1, min(p2, p3));
+        BB = max(p1, max(p2, p3));
+        return true;
+    }
+
+    // 只做几何判断，不计算法向量和纹理
+    bool occluded(Ray ray, float tMax) override {
+        vec3 pvec = cross(ray.direction, e2);
+        float det = dot(e1, pvec);
+        if (fabs(det) < EPS) return false;
+
+        float invDet = 1.0f / det;
+        vec3 tvec = ray.startPoint - p1;
+        float u = dot(tvec, pvec) * invDet;
+        if (u < 0.0f || u > 1.0f) return false;
+
+        vec3 qvec = cross(tvec, e1);
+        float v = dot(ray.direction, qvec) * invDet;
+        if (v < 0.0f || u + v > 1.0f) return false;
+
+        float t = dot(e2, qvec) * invDet;
+        return t >= 0.0005f && t < tMax;
+    }
 
     // Light Sample for Next Event Estimation
     LightSampleResult sampleLight() const {
-        float r1 = randf();
-        float r2 = randf();
+        double u1, u2;
+        sample2D(u1, u2);
+        float r1 = u1;
+        float r2 = u2;
         LightSampleResult res;
         //利用重心坐标系的三角形随机均匀点采样
         res.origin = (1.0f - sqrt(r1)) * p1 + (sqrt(r1) * (1.0f - r2)) * p2 + (sqrt(r1) * r2) * p3;
@@ -173,39 +220,61 @@ public:
         return O1 + (time - time0) / (time1 - time0) * (O_prime - O1);
     }
 
-    HitResult intersect(Ray ray) {
-        HitResult res;
+    bool intersect(const Ray& ray, HitRecord& rec) override {
+        float t;
+        if (!solve(ray, t) || t >= rec.distance) return false;
 
-        vec3 O = get_O(ray.time);
+        rec.distance = t;
+        rec.shape = this;
+        rec.primID = -1;
+        rec.time = ray.time;
+        return true;
+    }
 
+    void resolve(const Ray& ray, const HitRecord& rec, HitResult& res) override {
+        vec3 O = get_O(ray.time);
         vec3 S = ray.startPoint;
-        vec3 d = ray.direction;
-
-        float OS = length(O - S);
-        float SH = dot(O - S, d);
-        float OH = sqrt(pow(OS, 2) - pow(SH, 2));
-
-        if (OH > R) return res;
-
-        float PH = sqrt(pow(R, 2) - pow(OH, 2));
-
-        float t1 = length(SH) - PH;
-        float t2 = length(SH) + PH;
-        float t = (t1 < 0) ? (t2) : (t1);
-        vec3 P = S + t * d;
-
-        if (fabs(t1) < 0.0005f || fabs(t2) < 0.0005f) return res;
+        vec3 P = S + rec.distance * ray.direction;
 
         res.isHit = true;
-        res.distance = t;
+        res.distance = rec.distance;
         res.hitPoint = P;
-        res.material = material;
-        res.material.normal = t1 > 0 ?(normalize(P - O)): -(normalize(P - O)); //from inside???
+        res.material = &material;
+        // 起点在球外时 t1 > 0，法向量朝外
+        res.normal = dot(S - O, S - O) > R * R ?(normalize(P - O)): -(normalize(P - O)); //from inside???
 
-        res.time = ray.time;
+        res.time = rec.time;
 
         res.hitColor = material.color;
+    }
 
-        return res;
+    // 运动模糊的球取 time0 和 time1 两个位置的并
+    bool getBounds(vec3& AA, vec3& BB) override {
+        vec3 r = vec3(R, R, R);
+        vec3 O2 = time0 == time1 ? O1 : O_prime;
+        AA = min(O1, O2) - r;
+        BB = max(O1, O2) + r;
+        return true;
+    }
+
+    bool occluded(Ray ray, float tMax) override {
+        float t;
+        return solve(ray, t) && t < tMax;
+    }
+
+    // 解 |S + t d - O|^2 = R^2，取大于 0.0005 的较小根；intersect 和 occluded 共用，保证二者判断一致。
+    // 光线几乎擦过球面时判别式可能因舍入误差为负，直接当作没有交点
+    bool solve(const Ray& ray, float& t) {
+        vec3 O = get_O(ray.time);
+        vec3 OS = ray.startPoint - O;
+        float b = dot(OS, ray.direction);
+        float c = dot(OS, OS) - float(R * R);
+        float disc = b * b - c;
+        if (disc < 0) return false;
+
+        float h = sqrt(disc);
+        t = -b - h;
+        if (t < 0.0005f) t = -b + h;
+        return t >= 0.0005f;
     }
 };
\ No newline at end of file
@@ -1,7 +1,8 @@
 #pragma once
 #include "../externals/glm/glm.hpp"
-#include <random>
+#include <cstdint>
 #include "texture.h"
+#include "sampler.h"
 using namespace glm;
 
 //==========================================const===========================================//
@@ -27,13 +28,32 @@ constexpr float RAY_EPS = 1e-3f;
 
 //==========================================random==========================================//
 
-// 0-1 随机数生成
-std::uniform_real_distribution<> dis(0.0, 1.0);
-std::random_device rd;
-std::mt19937 gen(rd());
+thread_local Sampler sampler;
+
+// 渲染时每个像素的每个样本都重新设定种子，
+// 这样结果只取决于 seed，和线程数以及线程调度顺序无关
+void seedRandom(uint64_t seed, uint64_t sampleIndex) {
+    sampler.rng.seed(seed, sampleIndex);
+}
 
+// 开始像素 pixel 的第 index 个样本，之后 sample1D / sample2D 从头取维度
+void startSample(SamplerType type, uint64_t seed, uint64_t pixel, uint32_t index) {
+    sampler.start(type, seed, pixel, index);
+}
+
+// 0-1 随机数生成
 double randf() {
-    return dis(gen);
+    return sampler.random();
+}
+
+// 采样器的下一维，用于像素内位置、镜头、时间、光源上的点、反弹方向这些需要分层的地方；
+// 拒绝采样这类用掉的随机数个数不固定的地方仍然用 randf
+double sample1D() {
+    return sampler.get1D();
+}
+
+void sample2D(double& u, double& v) {
+    sampler.get2D(u, v);
 }
 
 vec3 randomVec3() {
@@ -96,12 +116,26 @@ enum BRDFType {
 
 //==========================================data==========================================//
 
-// 光线求交结果
+class Shape;
+
+// 求交记录：求交时只记录比较远近和之后还原表面所需的最少信息，
+// 法向量、纹理颜色和材质等到确定最近交点之后再由 Shape::resolve 计算
+typedef struct HitRecord {
+    float distance = 1e9;   // 与交点的距离，同时作为求交时的裁剪距离
+    Shape* shape = nullptr; // 命中的物体
+    int primID = -1;        // 物体内部的图元下标（如 Mesh 中的三角形）
+    float u = 0, v = 0;     // 重心坐标或曲面参数
+    float time = 0; // for motion blur
+} HitRecord;
+
+// 光线求交结果（还原后的表面信息）
 typedef struct HitResult {
     bool isHit = false;             // 是否命中
     float distance = 1e9; // 与交点的距离
     vec3 hitPoint = vec3(0, 0, 0);  // 光线命中点
-    Material material;              // 命中点的表面材质
+    const Material* material = nullptr; // 命中点的表面材质，引用物体自身的材质而不复制
+    Shape* shape = nullptr;         // 命中的物体，MIS 时用来查询光源被采样到的概率
+    vec3 normal = vec3(0, 0, 0);    // 着色法向量
     vec3 hitColor;                 // 纹理映射颜色 or 颜色
     float time; // for motion blur
 } HitResult;
@@ -154,8 +188,10 @@ float min(float a, float b) {
 
 // sample point on the disk
 vec2 sampleDisk(float R, float& pdf) {
-    float u1 = randf();
-    float u2 = randf();
+    double u, v;
+    sample2D(u, v);
+    float u1 = u;
+    float u2 = v;
     const float r = R * std::sqrt(u1);
     const float theta = PI_MUL_2 * u2;
     pdf = 1.0f / (R * R) * PI_INV;